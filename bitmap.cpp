@@ -66,3 +66,82 @@ uint8_t *decode_bitmap(const uint8_t *src, bool alpha, int colorKey, int *w, int
 	*h = height;
 	return dst;
 }
+
+static bool skipBytes(BitmapReadProc readProc, void *userdata, uint32_t len) {
+	uint8_t buf[256];
+	while (len != 0) {
+		const uint32_t count = (len < sizeof(buf)) ? len : sizeof(buf);
+		if (!readProc(userdata, buf, count)) {
+			return false;
+		}
+		len -= count;
+	}
+	return true;
+}
+
+// reads the bitmap sequentially and converts each row to RGB as it comes in
+uint8_t *decode_bitmap_stream(BitmapReadProc readProc, void *userdata, int *w, int *h) {
+	static const int kHeaderSize = 14 /* BITMAPFILEHEADER */ + 40 /* BITMAPINFOHEADER */;
+	uint8_t hdr[kHeaderSize];
+	if (!readProc(userdata, hdr, kHeaderSize) || memcmp(hdr, "BM", 2) != 0) {
+		return 0;
+	}
+	const uint32_t imageOffset = READ_LE_UINT32(hdr + 0xA);
+	const int width = READ_LE_UINT32(hdr + 0x12);
+	const int height = READ_LE_UINT32(hdr + 0x16);
+	const int depth = READ_LE_UINT16(hdr + 0x1C);
+	const int compression = READ_LE_UINT32(hdr + 0x1E);
+	if ((depth != 8 && depth != 32) || compression != 0 || imageOffset < kHeaderSize) {
+		warning("Unhandled bitmap depth %d compression %d", depth, compression);
+		return 0;
+	}
+	uint8_t palette[256 * 4];
+	memset(palette, 0, sizeof(palette));
+	uint32_t paletteSize = 0;
+	if (depth == 8) {
+		paletteSize = imageOffset - kHeaderSize;
+		if (paletteSize > sizeof(palette)) {
+			paletteSize = sizeof(palette);
+		}
+		if (!readProc(userdata, palette, paletteSize)) {
+			return 0;
+		}
+	}
+	if (!skipBytes(readProc, userdata, imageOffset - kHeaderSize - paletteSize)) {
+		return 0;
+	}
+	const int bpp = 3;
+	const int pitch = (depth == 8) ? ((width + 3) & ~3) : width * 4;
+	uint8_t *row = (uint8_t *)malloc(pitch);
+	uint8_t *dst = (uint8_t *)malloc(width * height * bpp);
+	if (!row || !dst) {
+		warning("Failed to allocate bitmap buffer, width %d height %d bpp %d", width, height, bpp);
+		free(row);
+		free(dst);
+		return 0;
+	}
+	for (int y = height - 1; y >= 0; --y) {
+		if (!readProc(userdata, row, pitch)) {
+			warning("Failed to read bitmap row %d", y);
+			free(row);
+			free(dst);
+			return 0;
+		}
+		if (depth == 8) {
+			clut(row, palette, pitch, width, 1, bpp, false, -1, dst + y * width * bpp);
+		} else {
+			const uint8_t *p = row;
+			uint8_t *q = dst + y * width * bpp;
+			for (int x = 0; x < width; ++x) {
+				const uint32_t color = READ_LE_UINT32(p); p += 4;
+				*q++ = (color >> 16) & 255;
+				*q++ = (color >>  8) & 255;
+				*q++ =  color        & 255;
+			}
+		}
+	}
+	free(row);
+	*w = width;
+	*h = height;
+	return dst;
+}
@@ -6,4 +6,8 @@
 
 uint8_t *decode_bitmap(const uint8_t *src, bool alpha, int colorKey, int *w, int *h);
 
+typedef bool (*BitmapReadProc)(void *userdata, uint8_t *dst, uint32_t len);
+
+uint8_t *decode_bitmap_stream(BitmapReadProc readProc, void *userdata, int *w, int *h);
+
 #endif
@@ -0,0 +1,76 @@
+
+#include "bitmapcache.h"
+#include "util.h"
+
+BitmapCache::BitmapCache()
+	: _size(0), _maxSize(0) {
+}
+
+BitmapCache::~BitmapCache() {
+	clear();
+}
+
+void BitmapCache::setMaxSize(uint32_t size) {
+	_maxSize = size;
+	evict(0);
+}
+
+void BitmapCache::evict(uint32_t size) {
+	while (!_entries.empty() && _size + size > _maxSize) {
+		BitmapCacheEntry &e = _entries.back();
+		_size -= e.size;
+		free(e.data);
+		_entries.pop_back();
+	}
+}
+
+const BitmapCacheEntry *BitmapCache::find(int num, int dataType) {
+	for (std::list<BitmapCacheEntry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+		if (it->num == num && it->dataType == dataType) {
+			if (it != _entries.begin()) {
+				_entries.splice(_entries.begin(), _entries, it);
+			}
+			return &_entries.front();
+		}
+	}
+	return 0;
+}
+
+void BitmapCache::add(int num, int dataType, int fmt, int w, int h, const uint8_t *data, uint32_t size) {
+	if (size > _maxSize) {
+		return;
+	}
+	for (std::list<BitmapCacheEntry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+		if (it->num == num && it->dataType == dataType) {
+			_size -= it->size;
+			free(it->data);
+			_entries.erase(it);
+			break;
+		}
+	}
+	evict(size);
+	BitmapCacheEntry e;
+	e.num = num;
+	e.dataType = dataType;
+	e.fmt = fmt;
+	e.w = w;
+	e.h = h;
+	e.size = size;
+	e.data = (uint8_t *)malloc(size);
+	if (!e.data) {
+		warning("Unable to allocate %d bytes for bitmap %d", size, num);
+		return;
+	}
+	memcpy(e.data, data, size);
+	_entries.push_front(e);
+	_size += size;
+	debug(DBG_VIDEO, "BitmapCache::add() num %d size %d total %d", num, size, _size);
+}
+
+void BitmapCache::clear() {
+	for (std::list<BitmapCacheEntry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+		free(it->data);
+	}
+	_entries.clear();
+	_size = 0;
+}
@@ -0,0 +1,33 @@
+
+#ifndef BITMAPCACHE_H__
+#define BITMAPCACHE_H__
+
+#include <list>
+#include "intern.h"
+
+struct BitmapCacheEntry {
+	int num;
+	int dataType;
+	int fmt;
+	int w, h;
+	uint32_t size;
+	uint8_t *data;
+};
+
+// decoded (and scaled) background bitmaps, least recently used are evicted first
+struct BitmapCache {
+	std::list<BitmapCacheEntry> _entries;
+	uint32_t _size;
+	uint32_t _maxSize;
+
+	BitmapCache();
+	~BitmapCache();
+
+	void setMaxSize(uint32_t size);
+	const BitmapCacheEntry *find(int num, int dataType);
+	void add(int num, int dataType, int fmt, int w, int h, const uint8_t *data, uint32_t size);
+	void clear();
+	void evict(uint32_t size);
+};
+
+#endif
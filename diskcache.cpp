@@ -0,0 +1,117 @@
+
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include "diskcache.h"
+#include "file.h"
+#include "util.h"
+
+const char *DiskCache::_path = 0;
+
+static const uint32_t TAG = 0x43574152; // 'RAWC'
+static const int HEADER_SIZE = 16;
+
+static uint32_t _dataSet;
+static std::map<std::string, File *> _entries;
+
+static void getEntryPath(const char *name, char *path, int size) {
+	snprintf(path, size, "%s/%08x_%s.bin", DiskCache::_path, _dataSet, name);
+}
+
+void DiskCache::setDataSet(const char *dataDir, int dataType) {
+	clear();
+	if (_path) {
+		struct stat st;
+		if (stat(_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+			warning("Cache path '%s' is not a directory", _path);
+			_path = 0;
+			return;
+		}
+	}
+	char buf[16];
+	snprintf(buf, sizeof(buf), "/%d", dataType);
+	_dataSet = hash(dataDir) ^ hash(buf);
+}
+
+uint32_t DiskCache::hash(const char *s) {
+	// FNV-1a
+	uint32_t h = 0x811C9DC5;
+	for (; *s; ++s) {
+		h = (h ^ (uint8_t)*s) * 0x01000193;
+	}
+	return h;
+}
+
+uint8_t *DiskCache::lookup(const char *name, File &src, uint32_t *size) {
+	if (!_path) {
+		return 0;
+	}
+	File *f = 0;
+	std::map<std::string, File *>::iterator it = _entries.find(name);
+	if (it != _entries.end()) {
+		f = it->second;
+	} else {
+		char path[MAXPATHLEN];
+		getEntryPath(name, path, sizeof(path));
+		f = new File;
+		if (!f->openMmap(path, false)) {
+			delete f;
+			return 0;
+		}
+		_entries[name] = f;
+	}
+	const uint8_t *hdr = f->borrow(0, HEADER_SIZE);
+	if (!hdr || READ_LE_UINT32(hdr) != TAG || READ_LE_UINT32(hdr + 4) != src.size() || READ_LE_UINT32(hdr + 8) != src.mtime()) {
+		return 0;
+	}
+	const uint32_t dataSize = READ_LE_UINT32(hdr + 12);
+	uint8_t *p = f->borrow(HEADER_SIZE, dataSize);
+	if (p) {
+		debug(DBG_RESOURCE, "DiskCache::lookup() '%s' size %d", name, dataSize);
+		*size = dataSize;
+	}
+	return p;
+}
+
+void DiskCache::store(const char *name, File &src, const uint8_t *data, uint32_t size) {
+	if (!_path) {
+		return;
+	}
+	// a stale entry is replaced, drop its mapping
+	std::map<std::string, File *>::iterator it = _entries.find(name);
+	if (it != _entries.end()) {
+		delete it->second;
+		_entries.erase(it);
+	}
+	char path[MAXPATHLEN];
+	getEntryPath(name, path, sizeof(path));
+	char tmpPath[MAXPATHLEN + 4];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+	File f;
+	if (!f.openForWriting(tmpPath)) {
+		warning("Unable to open '%s' for writing", tmpPath);
+		return;
+	}
+	f.writeUint32LE(TAG);
+	f.writeUint32LE(src.size());
+	f.writeUint32LE(src.mtime());
+	f.writeUint32LE(size);
+	f.write((void *)data, size);
+	const bool err = f.ioErr();
+	f.close();
+	// written to a temporary file first, an interrupted run does not leave a truncated entry
+	if (err || rename(tmpPath, path) != 0) {
+		warning("Failed to write '%s'", path);
+		remove(tmpPath);
+		return;
+	}
+	debug(DBG_RESOURCE, "DiskCache::store() '%s' size %d", name, size);
+}
+
+void DiskCache::clear() {
+	for (std::map<std::string, File *>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+		delete it->second;
+	}
+	_entries.clear();
+}
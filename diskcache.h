@@ -0,0 +1,21 @@
+
+#ifndef DISKCACHE_H__
+#define DISKCACHE_H__
+
+#include "intern.h"
+
+struct File;
+
+// unpacked resources saved to disk, an entry is valid as long as its source file size and time match
+struct DiskCache {
+	static const char *_path;
+
+	static void setDataSet(const char *dataDir, int dataType);
+	static uint32_t hash(const char *s);
+	// returns a pointer to the mapped entry data, valid until clear() is called
+	static uint8_t *lookup(const char *name, File &src, uint32_t *size);
+	static void store(const char *name, File &src, const uint8_t *data, uint32_t size);
+	static void clear();
+};
+
+#endif
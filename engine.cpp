@@ -87,7 +87,9 @@ void Engine::setup(Language lang, int graphicsType, const char *scalerName, int
 	_res._lang = lang;
 	_res.allocMemBlock();
 	_res.readEntries();
+	_res.openPack();
 	_res.dumpEntries();
+	_res.loadResident();
 	const bool isNth = !Graphics::_is1991 && (_res.getDataType() == Resource::DT_15TH_EDITION || _res.getDataType() == Resource::DT_20TH_EDITION);
 	if (isNth) {
 		// get HD background bitmaps resolution
@@ -244,7 +246,7 @@ void Engine::titlePage() {
 
 void Engine::doWin31Logos() {
 	for (int num = 1; num <= 2; ++num) {
-		uint8_t *dib = _res._win31->getDib(num);
+		const uint8_t *dib = _res._win31->getDib(num);
 		if (dib) {
 			while (!_stub->_pi.quit) {
 				_vid.drawBitmapDIB(dib, _stub);
@@ -255,7 +257,6 @@ void Engine::doWin31Logos() {
 				}
 				_stub->sleep(50);
 			}
-			free(dib);
 		}
 	}
 	_state = kStateGame;
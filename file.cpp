@@ -8,6 +8,15 @@
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#include <map>
+#include <string>
+#include <vector>
 #include "file.h"
 #include "util.h"
 
@@ -21,6 +30,24 @@ struct File_impl {
 	virtual void seek(int off, int whence) = 0;
 	virtual int read(void *ptr, uint32_t len) = 0;
 	virtual int write(void *ptr, uint32_t len) = 0;
+	virtual uint8_t *map(uint32_t offset, uint32_t len) { return 0; }
+	virtual uint32_t mtime() = 0;
+	virtual int readAt(uint32_t offset, void *ptr, uint32_t len) = 0;
+	virtual int readVecAt(uint32_t offset, const FileVec *vec, int count) {
+		int total = 0;
+		for (int i = 0; i < count; ++i) {
+			const int r = readAt(offset, vec[i].ptr, vec[i].len);
+			if (r <= 0) {
+				break;
+			}
+			total += r;
+			offset += r;
+			if ((uint32_t)r != vec[i].len) {
+				break;
+			}
+		}
+		return total;
+	}
 };
 
 struct stdFile : File_impl {
@@ -72,7 +99,208 @@ struct stdFile : File_impl {
 		}
 		return 0;
 	}
+	uint32_t mtime() {
+		struct stat st;
+		if (_fp && fstat(fileno(_fp), &st) == 0) {
+			return st.st_mtime;
+		}
+		return 0;
+	}
+#ifndef _WIN32
+	// positional reads do not use nor update the stream position
+	int readAt(uint32_t offset, void *ptr, uint32_t len) {
+		if (_fp) {
+			const ssize_t r = pread(fileno(_fp), ptr, len, offset);
+			return (r < 0) ? 0 : r;
+		}
+		return 0;
+	}
+	int readVecAt(uint32_t offset, const FileVec *vec, int count) {
+		if (_fp) {
+			struct iovec iov[16];
+			if (count > 16) {
+				return File_impl::readVecAt(offset, vec, count);
+			}
+			for (int i = 0; i < count; ++i) {
+				iov[i].iov_base = vec[i].ptr;
+				iov[i].iov_len = vec[i].len;
+			}
+			const ssize_t r = preadv(fileno(_fp), iov, count, offset);
+			return (r < 0) ? 0 : r;
+		}
+		return 0;
+	}
+#else
+	int readAt(uint32_t offset, void *ptr, uint32_t len) {
+		seek(offset, SEEK_SET);
+		return read(ptr, len);
+	}
+#endif
+};
+
+// file data held in memory, the accessors are shared by the mapped and resident files
+struct memFile : File_impl {
+	uint8_t *_ptr;
+	uint32_t _size, _pos;
+	uint32_t _mtime;
+	memFile() : _ptr(0), _size(0), _pos(0), _mtime(0) {}
+	bool open(const char *path, const char *mode);
+	void close() {
+		_ptr = 0;
+		_size = _pos = 0;
+	}
+	uint32_t size() {
+		return _size;
+	}
+	void seek(int off, int whence) {
+		switch (whence) {
+		case SEEK_SET:
+			_pos = off;
+			break;
+		case SEEK_CUR:
+			_pos += off;
+			break;
+		case SEEK_END:
+			_pos = _size + off;
+			break;
+		}
+	}
+	int read(void *ptr, uint32_t len) {
+		uint32_t count = 0;
+		if (_pos < _size) {
+			count = _size - _pos;
+			if (count > len) {
+				count = len;
+			}
+			memcpy(ptr, _ptr + _pos, count);
+			_pos += count;
+		}
+		if (count != len) {
+			_ioErr = true;
+		}
+		return count;
+	}
+	int write(void *ptr, uint32_t len) {
+		_ioErr = true;
+		return 0;
+	}
+	uint32_t mtime() {
+		return _mtime;
+	}
+	uint8_t *map(uint32_t offset, uint32_t len) {
+		if (_ptr && offset <= _size && len <= _size - offset) {
+			return _ptr + offset;
+		}
+		return 0;
+	}
+	int readAt(uint32_t offset, void *ptr, uint32_t len) {
+		if (offset >= _size) {
+			return 0;
+		}
+		if (len > _size - offset) {
+			len = _size - offset;
+		}
+		memcpy(ptr, _ptr + offset, len);
+		return len;
+	}
+};
+
+struct ResidentData {
+	uint8_t *ptr;
+	uint32_t size;
+	uint32_t mtime;
+};
+
+bool File::_resident = false;
+
+// whole files read once and kept for the lifetime of the process, shared by all File instances
+static std::map<std::string, ResidentData> _residentFiles;
+static std::vector<uint8_t *> _staleFiles;
+
+bool memFile::open(const char *path, const char *mode) {
+	_ioErr = false;
+	std::map<std::string, ResidentData>::iterator it = _residentFiles.find(path);
+	if (it != _residentFiles.end()) {
+		// the file was replaced since it was read
+		struct stat st;
+		if (stat(path, &st) != 0 || (uint32_t)st.st_size != it->second.size || (uint32_t)st.st_mtime != it->second.mtime) {
+			// other instances may still point to the previous data
+			_staleFiles.push_back(it->second.ptr);
+			_residentFiles.erase(it);
+			it = _residentFiles.end();
+		}
+	}
+	if (it == _residentFiles.end()) {
+		stdFile f;
+		if (!f.open(path, mode)) {
+			return false;
+		}
+		ResidentData rd;
+		rd.size = f.size();
+		rd.mtime = f.mtime();
+		rd.ptr = (uint8_t *)malloc(rd.size);
+		if (!rd.ptr && rd.size != 0) {
+			warning("Unable to allocate %d bytes for '%s'", rd.size, path);
+			f.close();
+			return false;
+		}
+		const uint32_t count = f.read(rd.ptr, rd.size);
+		f.close();
+		if (count != rd.size) {
+			warning("Failed to read %d bytes from '%s'", rd.size, path);
+			free(rd.ptr);
+			return false;
+		}
+		debug(DBG_RESOURCE, "Resident file '%s' size %d", path, rd.size);
+		it = _residentFiles.insert(std::pair<std::string, ResidentData>(path, rd)).first;
+	}
+	_ptr = it->second.ptr;
+	_size = it->second.size;
+	_mtime = it->second.mtime;
+	_pos = 0;
+	return true;
+}
+
+#ifndef _WIN32
+struct mmapFile : memFile {
+	bool open(const char *path, const char *mode) {
+		_ioErr = false;
+		if (strcmp(mode, "rb") != 0) {
+			return false;
+		}
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		bool ret = false;
+		struct stat st;
+		if (fstat(fd, &st) == 0) {
+			_size = st.st_size;
+			_pos = 0;
+			_mtime = st.st_mtime;
+			if (_size == 0) {
+				ret = true;
+			} else {
+				// private mapping, pages are copied only if written to
+				void *ptr = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+				if (ptr != MAP_FAILED) {
+					_ptr = (uint8_t *)ptr;
+					ret = true;
+				}
+			}
+		}
+		::close(fd);
+		return ret;
+	}
+	void close() {
+		if (_ptr) {
+			munmap(_ptr, _size);
+			_ptr = 0;
+		}
+		_size = _pos = 0;
+	}
 };
+#endif
 
 File::File() {
 	_impl = new stdFile;
@@ -88,24 +316,72 @@ bool File::open(const char *filepath) {
 	return _impl->open(filepath, "rb");
 }
 
-static bool getFilePathNoCase(const char *filename, const char *path, char *out) {
-	bool ret = false;
+struct DirIndex {
+	bool exists;
+	time_t mtime;
+	std::map<std::string, std::string> names; // lowercase name to real name
+};
+
+// directory listings are scanned once and shared by all File instances
+static std::map<std::string, DirIndex> _dirIndex;
+
+static void lowerName(const char *name, std::string &out) {
+	char buf[MAXPATHLEN];
+	strncpy(buf, name, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	string_lower(buf);
+	out = buf;
+}
+
+static void scanDirectory(const char *path, DirIndex &index) {
+	index.names.clear();
+	index.exists = false;
+	index.mtime = 0;
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		return;
+	}
 	DIR *d = opendir(path);
 	if (d) {
+		index.exists = true;
+		index.mtime = st.st_mtime;
 		dirent *de;
 		while ((de = readdir(d)) != NULL) {
 			if (de->d_name[0] == '.') {
 				continue;
 			}
-			if (strcasecmp(de->d_name, filename) == 0) {
-				sprintf(out, "%s/%s", path, de->d_name);
-				ret = true;
-				break;
-			}
+			std::string name;
+			lowerName(de->d_name, name);
+			index.names.insert(std::pair<std::string, std::string>(name, de->d_name));
 		}
 		closedir(d);
 	}
-	return ret;
+}
+
+static bool getFilePathNoCase(const char *filename, const char *path, char *out) {
+	std::string name;
+	lowerName(filename, name);
+	std::map<std::string, DirIndex>::iterator it = _dirIndex.find(path);
+	if (it == _dirIndex.end()) {
+		it = _dirIndex.insert(std::pair<std::string, DirIndex>(path, DirIndex())).first;
+		scanDirectory(path, it->second);
+	}
+	std::map<std::string, std::string>::const_iterator n = it->second.names.find(name);
+	if (n == it->second.names.end()) {
+		// rescan if the directory changed since it was indexed
+		struct stat st;
+		const bool exists = (stat(path, &st) == 0);
+		if (exists == it->second.exists && (!exists || st.st_mtime == it->second.mtime)) {
+			return false;
+		}
+		scanDirectory(path, it->second);
+		n = it->second.names.find(name);
+		if (n == it->second.names.end()) {
+			return false;
+		}
+	}
+	sprintf(out, "%s/%s", path, n->second.c_str());
+	return true;
 }
 
 bool File::open(const char *filename, const char *path) {
@@ -117,8 +393,43 @@ bool File::open(const char *filename, const char *path) {
 	return false;
 }
 
+bool File::openMmap(const char *filepath, bool resident) {
+	_impl->close();
+	if (_resident && resident) {
+		delete _impl;
+		_impl = new memFile;
+		if (_impl->open(filepath, "rb")) {
+			return true;
+		}
+		delete _impl;
+		_impl = new stdFile;
+		return false;
+	}
+#ifndef _WIN32
+	delete _impl;
+	_impl = new mmapFile;
+	if (_impl->open(filepath, "rb")) {
+		return true;
+	}
+	delete _impl;
+	_impl = new stdFile;
+#endif
+	return _impl->open(filepath, "rb");
+}
+
+bool File::openMmap(const char *filename, const char *path, bool resident) {
+	char filepath[MAXPATHLEN];
+	if (getFilePathNoCase(filename, path, filepath)) {
+		return openMmap(filepath, resident);
+	}
+	_impl->close();
+	return false;
+}
+
 bool File::openForWriting(const char *filepath) {
 	_impl->close();
+	delete _impl;
+	_impl = new stdFile;
 	return _impl->open(filepath, "wb");
 }
 
@@ -142,6 +453,22 @@ int File::read(void *ptr, uint32_t len) {
 	return _impl->read(ptr, len);
 }
 
+int File::readAt(uint32_t offset, void *ptr, uint32_t len) {
+	return _impl->readAt(offset, ptr, len);
+}
+
+int File::readVecAt(uint32_t offset, const FileVec *vec, int count) {
+	return _impl->readVecAt(offset, vec, count);
+}
+
+uint8_t *File::borrow(uint32_t offset, uint32_t len) {
+	return _impl->map(offset, len);
+}
+
+uint32_t File::mtime() {
+	return _impl->mtime();
+}
+
 uint8_t File::readByte() {
 	uint8_t b;
 	read(&b, 1);
@@ -200,6 +527,25 @@ void File::writeUint32BE(uint32_t n) {
 	writeUint16BE(n & 0xFFFF);
 }
 
+uint32_t File::getResidentSize() {
+	uint32_t size = 0;
+	for (std::map<std::string, ResidentData>::const_iterator it = _residentFiles.begin(); it != _residentFiles.end(); ++it) {
+		size += it->second.size;
+	}
+	return size;
+}
+
+void File::clearResident() {
+	for (std::map<std::string, ResidentData>::iterator it = _residentFiles.begin(); it != _residentFiles.end(); ++it) {
+		free(it->second.ptr);
+	}
+	_residentFiles.clear();
+	for (size_t i = 0; i < _staleFiles.size(); ++i) {
+		free(_staleFiles[i]);
+	}
+	_staleFiles.clear();
+}
+
 void dumpFile(const char *filename, const uint8_t *p, int size) {
 	char path[MAXPATHLEN];
 	snprintf(path, sizeof(path), "DUMP/%s", filename);
@@ -12,20 +12,38 @@
 
 struct File_impl;
 
+struct FileVec {
+	void *ptr;
+	uint32_t len;
+};
+
 struct File {
 	File();
 	~File();
 
+	// data files opened with openMmap are read to memory once and kept there
+	static bool _resident;
+
 	File_impl *_impl;
 
 	bool open(const char *filepath);
 	bool open(const char *filename, const char *path);
+	// resident is false for the unpacked data, kept mapped to be shared with the other instances
+	bool openMmap(const char *filepath, bool resident = true);
+	bool openMmap(const char *filename, const char *path, bool resident = true);
 	bool openForWriting(const char *filepath);
 	void close();
 	bool ioErr() const;
 	uint32_t size();
 	void seek(int off, int whence = SEEK_SET);
 	int read(void *ptr, uint32_t len);
+	// positional reads, safe to use from several threads on the same file
+	int readAt(uint32_t offset, void *ptr, uint32_t len);
+	int readVecAt(uint32_t offset, const FileVec *vec, int count);
+	// pointer to the data of a memory mapped file, valid until the file is closed
+	uint8_t *borrow(uint32_t offset, uint32_t len);
+	// modification time of the opened file
+	uint32_t mtime();
 	uint8_t readByte();
 	uint16_t readUint16LE();
 	uint32_t readUint32LE();
@@ -37,6 +55,9 @@ struct File {
 	void writeUint32LE(uint32_t n);
 	void writeUint16BE(uint16_t n);
 	void writeUint32BE(uint32_t n);
+
+	static uint32_t getResidentSize();
+	static void clearResident();
 };
 
 void dumpFile(const char *filename, const uint8_t *p, int size);
@@ -61,6 +61,11 @@ struct Graphics {
 	virtual void drawPoint(int buffer, uint8_t color, const Point *pt) = 0;
 	virtual void drawQuadStrip(int buffer, uint8_t color, const QuadStrip *qs) = 0;
 	virtual void drawStringChar(int buffer, uint8_t color, char c, const Point *pt) = 0;
+	virtual void drawStringChars(int buffer, uint8_t color, const char *chars, const Point *pts, int count) {
+		for (int i = 0; i < count; ++i) {
+			drawStringChar(buffer, color, chars[i], &pts[i]);
+		}
+	}
 	virtual void clearBuffer(int num, uint8_t color) = 0;
 	virtual void copyBuffer(int dst, int src, int vscroll = 0) = 0;
 	virtual void drawBuffer(int num, SystemStub *) = 0;
@@ -61,15 +61,19 @@ struct Texture {
 	GLuint _id;
 	int _w, _h;
 	float _u, _v;
+	int _glFmt, _glType;
 	uint8_t *_rgbData;
-	const uint8_t *_raw16Data;
+	uint8_t *_indexData;
+	int _dataW, _dataH;
 	int _fmt;
 
 	void init();
 	void uploadDataCLUT(const uint8_t *data, int srcPitch, int w, int h, const Color *pal);
 	void uploadDataRGB(const void *data, int srcPitch, int w, int h, int fmt, int type);
+	void updatePalette(const Color *pal);
 	void draw(int w, int h);
 	void clear();
+	void freeData();
 	void readRaw16(const uint8_t *src, const Color *pal, int w, int h);
 	void readFont(const uint8_t *src);
 	void readRGB555(const uint16_t *src, int w, int h);
@@ -80,26 +84,32 @@ void Texture::init() {
 	_id = kNoTextureId;
 	_w = _h = 0;
 	_u = _v = 0.f;
+	_glFmt = _glType = 0;
 	_rgbData = 0;
-	_raw16Data = 0;
+	_indexData = 0;
+	_dataW = _dataH = 0;
 	_fmt = -1;
 }
 
 static void convertTextureCLUT(const uint8_t *src, const int srcPitch, int w, int h, uint8_t *dst, int dstPitch, const Color *pal, bool alpha) {
+	// expand the 16 colors palette once, each pixel is then a single 32 bits store
+	uint32_t lut[256];
+	for (int i = 0; i < 256; ++i) {
+		uint8_t rgba[4] = { 0, 0, 0, 255 };
+		if (i < 16) {
+			rgba[0] = pal[i].r;
+			rgba[1] = pal[i].g;
+			rgba[2] = pal[i].b;
+		}
+		if (alpha && i == 0) {
+			rgba[3] = 0;
+		}
+		memcpy(&lut[i], rgba, sizeof(uint32_t));
+	}
 	for (int y = 0; y < h; ++y) {
-		int offset = 0;
+		uint32_t *p = (uint32_t *)dst;
 		for (int x = 0; x < w; ++x) {
-			const uint8_t color = src[x];
-			dst[offset++] = pal[color].r;
-			dst[offset++] = pal[color].g;
-			dst[offset++] = pal[color].b;
-			if (alpha) {
-				if (color == 0) {
-					dst[offset++] = 0;
-				} else {
-					dst[offset++] = 255;
-				}
-			}
+			p[x] = lut[src[x]];
 		}
 		dst += dstPitch;
 		src += srcPitch;
@@ -107,61 +117,67 @@ static void convertTextureCLUT(const uint8_t *src, const int srcPitch, int w, in
 }
 
 void Texture::uploadDataCLUT(const uint8_t *data, int srcPitch, int w, int h, const Color *pal) {
-	if (w != _w || h != _h) {
-		free(_rgbData);
-		_rgbData = 0;
-	}
-	int depth = 1;
-	int fmt = GL_RGB;
-	int type = GL_UNSIGNED_BYTE;
 	switch (_fmt) {
 	case FMT_CLUT:
-		depth = 3;
-		fmt = GL_RGB;
-		break;
 	case FMT_RGB:
-		depth = 3;
-		fmt = GL_RGB;
-		break;
 	case FMT_RGBA:
-		depth = 4;
-		fmt = GL_RGBA;
 		break;
 	default:
 		return;
 	}
+	// paletted textures are always expanded to RGBA
+	const int depth = 4;
+	const int fmt = GL_RGBA;
+	const int type = GL_UNSIGNED_BYTE;
 	const bool alpha = (_fmt == FMT_RGBA);
-	if (!_rgbData) {
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (!_rgbData || w != _dataW || h != _dataH || _glFmt != fmt) {
+		clear();
 		_w = _npotTex ? w : roundPow2(w);
 		_h = _npotTex ? h : roundPow2(h);
-		_rgbData = (uint8_t *)malloc(_w * _h * depth);
+		_rgbData = (uint8_t *)calloc(_w * _h, depth);
 		if (!_rgbData) {
 			return;
 		}
+		_dataW = w;
+		_dataH = h;
 		_u = w / (float)_w;
 		_v = h / (float)_h;
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		_glFmt = fmt;
+		_glType = type;
 		glGenTextures(1, &_id);
 		glBindTexture(GL_TEXTURE_2D, _id);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (fmt == GL_RED) ? GL_NEAREST : GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (fmt == GL_RED) ? GL_NEAREST : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 		convertTextureCLUT(data, srcPitch, w, h, _rgbData, _w * depth, pal, alpha);
 		glTexImage2D(GL_TEXTURE_2D, 0, fmt, _w, _h, 0, fmt, type, _rgbData);
 	} else {
+		// same storage, only update the area covered by the bitmap
 		glBindTexture(GL_TEXTURE_2D, _id);
 		convertTextureCLUT(data, srcPitch, w, h, _rgbData, _w * depth, pal, alpha);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _w, _h, fmt, type, _rgbData);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, _w);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, fmt, type, _rgbData);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	}
 }
 
 void Texture::uploadDataRGB(const void *data, int srcPitch, int w, int h, int fmt, int type) {
+	freeData();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (_id != kNoTextureId && w == _w && h == _h && fmt == _glFmt && type == _glType) {
+		glBindTexture(GL_TEXTURE_2D, _id);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, fmt, type, data);
+		return;
+	}
+	clear();
 	_w = w;
 	_h = h;
 	_u = 1.f;
 	_v = 1.f;
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	_glFmt = fmt;
+	_glType = type;
 	glGenTextures(1, &_id);
 	glBindTexture(GL_TEXTURE_2D, _id);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -171,6 +187,12 @@ void Texture::uploadDataRGB(const void *data, int srcPitch, int w, int h, int fm
 	glTexImage2D(GL_TEXTURE_2D, 0, fmt, _w, _h, 0, fmt, type, data);
 }
 
+void Texture::updatePalette(const Color *pal) {
+	if (_fmt == FMT_CLUT && _indexData) {
+		uploadDataCLUT(_indexData, _dataW, _dataW, _dataH, pal);
+	}
+}
+
 void Texture::draw(int w, int h) {
 	if (_id != kNoTextureId) {
 		glEnable(GL_TEXTURE_2D);
@@ -195,14 +217,32 @@ void Texture::clear() {
 		glDeleteTextures(1, &_id);
 		_id = kNoTextureId;
 	}
+	_glFmt = _glType = 0;
+	// the CLUT indices are kept, they are the source of the upload when resizing
 	free(_rgbData);
 	_rgbData = 0;
-	_raw16Data = 0;
+	_dataW = _dataH = 0;
+}
+
+void Texture::freeData() {
+	free(_rgbData);
+	_rgbData = 0;
+	free(_indexData);
+	_indexData = 0;
+	_dataW = _dataH = 0;
 }
 
 void Texture::readRaw16(const uint8_t *src, const Color *pal, int w, int h) {
-	_raw16Data = src;
-	uploadDataCLUT(_raw16Data, w, w, h, pal);
+	// keep the indices to recolor the texture on palette changes
+	if (!_indexData || w != _dataW || h != _dataH) {
+		free(_indexData);
+		_indexData = (uint8_t *)malloc(w * h);
+		if (!_indexData) {
+			return;
+		}
+	}
+	memcpy(_indexData, src, w * h);
+	uploadDataCLUT(_indexData, w, w, h, pal);
 }
 
 void Texture::readFont(const uint8_t *src) {
@@ -219,8 +259,8 @@ void Texture::readFont(const uint8_t *src) {
 				}
 			}
 		}
-		Color pal[2];
-		pal[0].r = pal[0].g = pal[0].b = 0;
+		Color pal[16];
+		memset(pal, 0, sizeof(pal));
 		pal[1].r = pal[1].g = pal[1].b = 255;
 		uploadDataCLUT(out, W, W, H, pal);
 		free(out);
@@ -235,14 +275,15 @@ static uint16_t rgb555_to_565(const uint16_t color) {
 }
 
 void Texture::readRGB555(const uint16_t *src, int w, int h) {
-	_rgbData = (uint8_t *)malloc(w * h * sizeof(uint16_t));
-	if (!_rgbData) {
+	uint16_t *rgb = (uint16_t *)malloc(w * h * sizeof(uint16_t));
+	if (!rgb) {
 		return;
 	}
 	for (int i = 0; i < w * h; ++i) {
-		((uint16_t *)_rgbData)[i] = rgb555_to_565(src[i]);
+		rgb[i] = rgb555_to_565(src[i]);
 	}
-	uploadDataRGB(_rgbData, w * sizeof(uint16_t), w, h, GL_RGB, GL_UNSIGNED_SHORT_5_6_5);
+	uploadDataRGB(rgb, w * sizeof(uint16_t), w, h, GL_RGB, GL_UNSIGNED_SHORT_5_6_5);
+	free(rgb);
 }
 
 struct DrawListEntry {
@@ -259,9 +300,10 @@ struct DrawList {
 	int fillColor;
 	Entries entries;
 	int yOffset;
+	int bitmapNum;
 
 	DrawList()
-		: fillColor(0), yOffset(0) {
+		: fillColor(0), yOffset(0), bitmapNum(0) {
 	}
 
 	void clear(uint8_t color) {
@@ -302,6 +344,7 @@ struct GraphicsGL : Graphics {
 	GLuint _fbPage0;
 	GLuint _pageTex[NUM_LISTS];
 	DrawList _drawLists[NUM_LISTS];
+	int _bitmapNum;
 	struct {
 		int num;
 		Point pos;
@@ -319,6 +362,7 @@ struct GraphicsGL : Graphics {
 	virtual void drawPoint(int listNum, uint8_t color, const Point *pt);
 	virtual void drawQuadStrip(int listNum, uint8_t color, const QuadStrip *qs);
 	virtual void drawStringChar(int listNum, uint8_t color, char c, const Point *pt);
+	virtual void drawStringChars(int listNum, uint8_t color, const char *chars, const Point *pts, int count);
 	virtual void clearBuffer(int listNum, uint8_t color);
 	virtual void copyBuffer(int dstListNum, int srcListNum, int vscroll = 0);
 	virtual void drawBuffer(int listNum, SystemStub *stub);
@@ -337,6 +381,7 @@ GraphicsGL::GraphicsGL() {
 	_alphaColor = &_pal[ALPHA_COLOR_INDEX];
 	_spritesSizeX = _spritesSizeY = 0;
 	_sprite.num = -1;
+	_bitmapNum = 0;
 }
 
 void GraphicsGL::init(int targetW, int targetH) {
@@ -412,10 +457,13 @@ void GraphicsGL::setPalette(const Color *colors, int n) {
 		_pal[i] = colors[i];
 	}
 	if (_fixUpPalette == FIXUP_PALETTE_REDRAW) {
+		bool bitmapUpdated = false;
 		for (int i = 0; i < NUM_LISTS; ++i) {
 			_fptr.glBindFramebuffer(GL_FRAMEBUFFER, _fbPage0);
 			glDrawBuffer(GL_COLOR_ATTACHMENT0 + i);
 
+			glViewport(0, 0, _fbW, _fbH);
+
 			glMatrixMode(GL_PROJECTION);
 			glLoadIdentity();
 			glOrtho(0, _fbW, 0, _fbH, 0, 1);
@@ -425,6 +473,13 @@ void GraphicsGL::setPalette(const Color *colors, int n) {
 				assert(color < 16);
 				glClearColor(_pal[color].r / 255.f, _pal[color].g / 255.f, _pal[color].b / 255.f, 1.f);
 				glClear(GL_COLOR_BUFFER_BIT);
+			} else if (_backgroundTex._fmt == FMT_CLUT && _drawLists[i].bitmapNum == _bitmapNum && _drawLists[i].yOffset == 0) {
+				// recolor the background bitmap from its indices
+				if (!bitmapUpdated) {
+					_backgroundTex.updatePalette(_pal);
+					bitmapUpdated = true;
+				}
+				_backgroundTex.draw(_fbW, _fbH);
 			}
 
 			glScalef((float)_fbW / SCREEN_W, (float)_fbH / SCREEN_H, 1);
@@ -453,18 +508,22 @@ void GraphicsGL::setSpriteAtlas(const uint8_t *src, int w, int h, int xSize, int
 	_spritesSizeY = ySize;
 }
 
+static void emitTexQuad(const int *pos, const float *uv) {
+	glTexCoord2f(uv[0], uv[1]);
+	glVertex2i(pos[0], pos[1]);
+	glTexCoord2f(uv[2], uv[1]);
+	glVertex2i(pos[2], pos[1]);
+	glTexCoord2f(uv[2], uv[3]);
+	glVertex2i(pos[2], pos[3]);
+	glTexCoord2f(uv[0], uv[3]);
+	glVertex2i(pos[0], pos[3]);
+}
+
 static void drawTexQuad(const int *pos, const float *uv, GLuint tex) {
 	glEnable(GL_TEXTURE_2D);
 	glBindTexture(GL_TEXTURE_2D, tex);
 	glBegin(GL_QUADS);
-		glTexCoord2f(uv[0], uv[1]);
-		glVertex2i(pos[0], pos[1]);
-		glTexCoord2f(uv[2], uv[1]);
-		glVertex2i(pos[2], pos[1]);
-		glTexCoord2f(uv[2], uv[3]);
-		glVertex2i(pos[2], pos[3]);
-		glTexCoord2f(uv[0], uv[3]);
-		glVertex2i(pos[0], pos[3]);
+		emitTexQuad(pos, uv);
 	glEnd();
 	glDisable(GL_TEXTURE_2D);
 }
@@ -512,11 +571,9 @@ void GraphicsGL::drawBitmap(int listNum, const uint8_t *data, int w, int h, int
 		_backgroundTex.readRaw16(data, _pal, w, h);
 		break;
 	case FMT_RGB:
-		_backgroundTex.clear();
 		_backgroundTex.uploadDataRGB(data, w * 3, w, h, GL_RGB, GL_UNSIGNED_BYTE);
 		break;
 	case FMT_RGB555:
-		_backgroundTex.clear();
 		_backgroundTex.readRGB555((const uint16_t *)data, w, h);
 		break;
 	}
@@ -532,6 +589,7 @@ void GraphicsGL::drawBitmap(int listNum, const uint8_t *data, int w, int h, int
 	_backgroundTex.draw(_fbW, _fbH);
 
 	_drawLists[listNum].clear(COL_BMP);
+	_drawLists[listNum].bitmapNum = ++_bitmapNum;
 }
 
 void GraphicsGL::drawVerticesToFb(uint8_t color, int count, const Point *vertices) {
@@ -592,6 +650,10 @@ void GraphicsGL::drawQuadStrip(int listNum, uint8_t color, const QuadStrip *qs)
 }
 
 void GraphicsGL::drawStringChar(int listNum, uint8_t color, char c, const Point *pt) {
+	drawStringChars(listNum, color, &c, pt, 1);
+}
+
+void GraphicsGL::drawStringChars(int listNum, uint8_t color, const char *chars, const Point *pts, int count) {
 	assert(listNum < NUM_LISTS);
 	_fptr.glBindFramebuffer(GL_FRAMEBUFFER, _fbPage0);
 	glDrawBuffer(GL_COLOR_ATTACHMENT0 + listNum);
@@ -605,28 +667,38 @@ void GraphicsGL::drawStringChar(int listNum, uint8_t color, char c, const Point
 	glScalef((float)_fbW / SCREEN_W, (float)_fbH / SCREEN_H, 1);
 
 	glColor4ub(_pal[color].r, _pal[color].g, _pal[color].b, 255);
-	if (_fontTex._h == 8) {
-		const int pos[4] = {
-			pt->x, pt->y,
-			pt->x + 8, pt->y + 8
-		};
-		const float uv[4] = {
-			(c - 0x20) * 16.f / _fontTex._w, 0.f,
-			(c - 0x20) * 16.f / _fontTex._w + 1 * 8.f / _fontTex._w, 1.f
-		};
-		drawTexQuad(pos, uv, _fontTex._id);
-	} else {
-		const int pos[4] = {
-			pt->x - 8, pt->y,
-			pt->x, pt->y + 8
-		};
-		float uv[4];
-		uv[0] = (c % 16) * 16 / 256.f;
-		uv[2] = uv[0] + 16 / 256.f;
-		uv[1] = (c / 16) * 16 / 256.f;
-		uv[3] = uv[1] + 16 / 256.f;
-		drawTexQuad(pos, uv, _fontTex._id);
+	// all the glyphs share the font texture, emit them as a single batch of quads
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, _fontTex._id);
+	glBegin(GL_QUADS);
+	for (int i = 0; i < count; ++i) {
+		const char c = chars[i];
+		const Point *pt = &pts[i];
+		if (_fontTex._h == 8) {
+			const int pos[4] = {
+				pt->x, pt->y,
+				pt->x + 8, pt->y + 8
+			};
+			const float uv[4] = {
+				(c - 0x20) * 16.f / _fontTex._w, 0.f,
+				(c - 0x20) * 16.f / _fontTex._w + 1 * 8.f / _fontTex._w, 1.f
+			};
+			emitTexQuad(pos, uv);
+		} else {
+			const int pos[4] = {
+				pt->x - 8, pt->y,
+				pt->x, pt->y + 8
+			};
+			float uv[4];
+			uv[0] = (c % 16) * 16 / 256.f;
+			uv[2] = uv[0] + 16 / 256.f;
+			uv[1] = (c / 16) * 16 / 256.f;
+			uv[3] = uv[1] + 16 / 256.f;
+			emitTexQuad(pos, uv);
+		}
 	}
+	glEnd();
+	glDisable(GL_TEXTURE_2D);
 
 	glLoadIdentity();
 	glScalef(1., 1., 1.);
@@ -0,0 +1,34 @@
+
+#include <time.h>
+#include "loadtrace.h"
+#include "util.h"
+
+FILE *LoadTrace::_fp = 0;
+
+bool LoadTrace::open(const char *path) {
+	close();
+	_fp = fopen(path, "w");
+	if (!_fp) {
+		warning("Unable to open '%s' for writing", path);
+		return false;
+	}
+	fprintf(_fp, "# kind num bytes us part request\n");
+	return true;
+}
+
+void LoadTrace::close() {
+	if (_fp) {
+		fclose(_fp);
+		_fp = 0;
+	}
+}
+
+uint64_t LoadTrace::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void LoadTrace::record(const char *kind, int num, uint32_t size, uint64_t start, int part, int request) {
+	fprintf(_fp, "%s %d %d %d %d %d\n", kind, num, size, (int)(now() - start), part, request);
+}
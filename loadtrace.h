@@ -0,0 +1,35 @@
+
+#ifndef LOADTRACE_H__
+#define LOADTRACE_H__
+
+#include "intern.h"
+
+// one line per resource loaded : kind, number, bytes, load time in microseconds, part and triggering request
+struct LoadTrace {
+	static FILE *_fp;
+
+	static bool open(const char *path);
+	static void close();
+	static uint64_t now();
+	static void record(const char *kind, int num, uint32_t size, uint64_t start, int part, int request);
+};
+
+// records the load when going out of scope, size is left to 0 when nothing was loaded
+struct LoadTraceScope {
+	const char *_kind;
+	int _num;
+	uint32_t _size;
+	uint64_t _start;
+	int _part, _request;
+
+	LoadTraceScope(const char *kind, int num, int part, int request)
+		: _kind(kind), _num(num), _size(0), _start(LoadTrace::_fp ? LoadTrace::now() : 0), _part(part), _request(request) {
+	}
+	~LoadTraceScope() {
+		if (LoadTrace::_fp && _size != 0) {
+			LoadTrace::record(_kind, _num, _size, _start, _part, _request);
+		}
+	}
+};
+
+#endif
@@ -7,8 +7,12 @@
 #include <SDL.h>
 #include <getopt.h>
 #include <sys/stat.h>
+#include "diskcache.h"
 #include "engine.h"
+#include "file.h"
 #include "graphics.h"
+#include "loadtrace.h"
+#include "scriptprofile.h"
 #include "resource.h"
 #include "systemstub.h"
 #include "util.h"
@@ -29,6 +33,12 @@ static const char USAGE[] =
 	"  --difficulty=DIFF Difficulty (easy,normal,hard)\n"
 	"  --audio=AUDIO     Audio (original,remastered)\n"
 	"  --mt32            Use MT32 sounds mapping with DOS version\n"
+	"  --bitmap-cache=KB Memory budget for decoded backgrounds (default 16384)\n"
+	"  --cache=PATH      Directory to keep unpacked resources in\n"
+	"  --write-pack=FILE Write the unpacked resources to FILE and exit\n"
+	"  --trace=FILE      Record the resources loaded to FILE\n"
+	"  --resident        Keep the data files in memory\n"
+	"  --profile=FILE    Write the script instruction counts and times to FILE\n"
 	;
 
 static const struct {
@@ -66,6 +76,7 @@ static const struct {
 bool Graphics::_is1991 = false;
 bool Graphics::_use555 = false;
 bool Video::_useEGA = false;
+int Video::_bitmapCacheSize = 16384;
 Difficulty Script::_difficulty = DIFFICULTY_NORMAL;
 bool Script::_useRemasteredAudio = true;
 
@@ -132,6 +143,7 @@ int main(int argc, char *argv[]) {
 	bool defaultGraphics = true;
 	bool demo3JoyInputs = false;
 	bool useMT32 = false;
+	char *packPath = 0;
 	if (argc == 2) {
 		// data path as the only command line argument
 		struct stat st;
@@ -154,6 +166,12 @@ int main(int argc, char *argv[]) {
 			{ "difficulty", required_argument, 0, 'i' },
 			{ "audio",    required_argument, 0, 'u' },
 			{ "mt32",       no_argument,     0, 'm' },
+			{ "bitmap-cache", required_argument, 0, 'b' },
+			{ "cache",    required_argument, 0, 'c' },
+			{ "write-pack", required_argument, 0, 'k' },
+			{ "trace",    required_argument, 0, 't' },
+			{ "resident",   no_argument,     0, 'x' },
+			{ "profile",  required_argument, 0, 'o' },
 			{ "help",       no_argument,     0, 'h' },
 			{ 0, 0, 0, 0 }
 		};
@@ -223,6 +241,24 @@ int main(int argc, char *argv[]) {
 		case 'm':
 			useMT32 = true;
 			break;
+		case 'b':
+			Video::_bitmapCacheSize = atoi(optarg);
+			break;
+		case 'c':
+			DiskCache::_path = strdup(optarg);
+			break;
+		case 'k':
+			packPath = strdup(optarg);
+			break;
+		case 't':
+			LoadTrace::open(optarg);
+			break;
+		case 'x':
+			File::_resident = true;
+			break;
+		case 'o':
+			ScriptProfile::open(optarg);
+			break;
 		case 'h':
 			// fall-through
 		default:
@@ -232,6 +268,13 @@ int main(int argc, char *argv[]) {
 	}
 	g_debugMask = DBG_INFO; // | DBG_VIDEO | DBG_SND | DBG_SCRIPT | DBG_BANK | DBG_SER;
 	Engine *e = new Engine(dataPath, part);
+	if (packPath) {
+		e->_res._lang = lang;
+		e->_res.readEntries();
+		const bool ret = e->_res.writePack(packPath);
+		delete e;
+		return ret ? 0 : 1;
+	}
 	if (defaultGraphics) {
 		// if not set, use original software graphics for 199x and 3DO versions and GL for the anniversary releases
 		graphicsType = getGraphicsType(e->_res.getDataType());
@@ -277,5 +320,8 @@ int main(int argc, char *argv[]) {
 	delete graphics;
 	stub->fini();
 	delete stub;
+	LoadTrace::close();
+	ScriptProfile::close();
+	File::clearResident();
 	return 0;
 }
@@ -39,6 +39,7 @@ struct MixerChannel {
 	uint32_t _len;
 	uint32_t _loopLen, _loopPos;
 	int _volume;
+	int *_ref; // reference to the sound cache entry, released when the channel is stopped
 	void (MixerChannel::*_mixWav)(int16_t *sample, int count);
 
 	void initRaw(const uint8_t *data, int freq, int volume, int mixingFreq) {
@@ -246,6 +247,9 @@ struct Mixer_impl {
 		}
 		Mix_CloseAudio();
 		Mix_Quit();
+		for (int i = 0; i < kMixChannels; ++i) {
+			releaseChannel(i);
+		}
 	}
 
 	void update() {
@@ -253,15 +257,31 @@ struct Mixer_impl {
 			if (_sounds[i] && !Mix_Playing(i)) {
 				freeSound(i);
 			}
+			// _ref is only changed from this thread, the sound ends in the audio callback
+			if (_channels[i]._ref) {
+				SDL_LockAudio();
+				if (!_channels[i]._data) {
+					releaseChannel(i);
+				}
+				SDL_UnlockAudio();
+			}
+		}
+	}
+
+	void releaseChannel(int channel) {
+		if (_channels[channel]._ref) {
+			--*_channels[channel]._ref;
+			_channels[channel]._ref = 0;
 		}
 	}
 
 	void playSoundRaw(uint8_t channel, const uint8_t *data, int freq, uint8_t volume) {
 		SDL_LockAudio();
+		releaseChannel(channel);
 		_channels[channel].initRaw(data, freq, volume, kMixFreq);
 		SDL_UnlockAudio();
 	}
-	void playSoundWav(uint8_t channel, const uint8_t *data, int freq, uint8_t volume, bool loop) {
+	void playSoundWav(uint8_t channel, const uint8_t *data, int freq, uint8_t volume, bool loop, int *ref) {
 		int wavFreq, len;
 		bool bits16, stereo;
 		const uint8_t *wavData = loadWav(data, wavFreq, len, bits16, stereo);
@@ -272,7 +292,12 @@ struct Mixer_impl {
 		}
 
 		SDL_LockAudio();
+		releaseChannel(channel);
 		_channels[channel].initWav(wavData, freq, volume, kMixFreq, len, bits16, stereo, loop);
+		_channels[channel]._ref = ref;
+		if (ref) {
+			++*ref;
+		}
 		SDL_UnlockAudio();
 	}
 	void playSound(uint8_t channel, int volume, Mix_Chunk *chunk, int loops = 0) {
@@ -289,6 +314,7 @@ struct Mixer_impl {
 		}
 		SDL_LockAudio();
 		_channels[channel]._data = 0;
+		releaseChannel(channel);
 		SDL_UnlockAudio();
 		Mix_HaltChannel(channel);
 		freeSound(channel);
@@ -508,10 +534,10 @@ void Mixer::playSoundRaw(uint8_t channel, const uint8_t *data, uint16_t freq, ui
 	}
 }
 
-void Mixer::playSoundWav(uint8_t channel, const uint8_t *data, uint16_t freq, uint8_t volume, uint8_t loop) {
+void Mixer::playSoundWav(uint8_t channel, const uint8_t *data, uint16_t freq, uint8_t volume, uint8_t loop, int *ref) {
 	debug(DBG_SND, "Mixer::playSoundWav(%d, %d, %d)", channel, volume, loop);
 	if (_impl) {
-		return _impl->playSoundWav(channel, data, freq, volume, loop);
+		return _impl->playSoundWav(channel, data, freq, volume, loop, ref);
 	}
 }
 
@@ -36,7 +36,7 @@ struct Mixer {
 	bool hasMt32SoundMapping(int num);
 
 	void playSoundRaw(uint8_t channel, const uint8_t *data, uint16_t freq, uint8_t volume);
-	void playSoundWav(uint8_t channel, const uint8_t *data, uint16_t freq, uint8_t volume, uint8_t loop);
+	void playSoundWav(uint8_t channel, const uint8_t *data, uint16_t freq, uint8_t volume, uint8_t loop, int *ref = 0);
 	void stopSound(uint8_t channel);
 	void playSoundMt32(int num);
 	void setChannelVolume(uint8_t channel, uint8_t volume);
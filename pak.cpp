@@ -1,4 +1,6 @@
 
+#include <ctype.h>
+#include "diskcache.h"
 #include "pak.h"
 #include "util.h"
 
@@ -6,25 +8,44 @@
 static const uint32_t XOR_KEY2 = 0x22683297;
 static const uint32_t CHECKSUM = 0x20202020;
 
-static uint8_t *decode_toodc(uint8_t *p, int count) {
+// the first decoded uint32_t is skipped, 'len - 4' bytes are written to dst.
+// dst can point to the encoded data, as long as it is not after src.
+static void decode_toodc(const uint8_t *src, uint8_t *dst, uint32_t len) {
 	uint32_t key = XOR_KEY2;
 	uint32_t acc = 0;
-	for (int i = 0; i < count; ++i) {
-		uint8_t *q = p + i * 4;
+	// the key of a word only depends on the encoded previous words
+	uint32_t i = 0;
+	for (; i + 4 <= len; i += 4) {
+		const uint8_t *q = src + i;
 		const uint32_t data = READ_LE_UINT32(q) ^ key;
-		uint32_t r = (q[2] + q[1] + q[0]) ^ q[3];
-		r += acc;
-		key += r;
+		key += ((q[2] + q[1] + q[0]) ^ q[3]) + acc;
 		acc += 0x4D;
-		WRITE_LE_UINT32(q, data);
+		if (i != 0) {
+			WRITE_LE_UINT32(dst + i - 4, data);
+		}
+	}
+	if (i < len && i != 0) {
+		uint8_t q[4];
+		memset(q, 0, sizeof(q));
+		memcpy(q, src + i, len - i);
+		WRITE_LE_UINT32(q, READ_LE_UINT32(q) ^ key);
+		memcpy(dst + i - 4, q, len - i);
+	}
+}
+
+static uint32_t hashName(const char *name) {
+	// FNV-1a, case insensitive
+	uint32_t h = 0x811C9DC5;
+	for (; *name; ++name) {
+		h = (h ^ (uint8_t)tolower(*name)) * 0x01000193;
 	}
-	return p + 4;
+	return h;
 }
 
 const char *Pak::FILENAME = "Pak01.pak";
 
 Pak::Pak()
-	: _entries(0), _entriesCount(0) {
+	: _entries(0), _entriesCount(0), _hashTable(0), _hashMask(0) {
 }
 
 Pak::~Pak() {
@@ -32,13 +53,16 @@ Pak::~Pak() {
 }
 
 void Pak::open(const char *dataPath) {
-	_f.open(FILENAME, dataPath);
+	_f.openMmap(FILENAME, dataPath);
 }
 
 void Pak::close() {
 	free(_entries);
 	_entries = 0;
 	_entriesCount = 0;
+	free(_hashTable);
+	_hashTable = 0;
+	_hashMask = 0;
 }
 
 static int comparePakEntry(const void *a, const void *b) {
@@ -80,6 +104,7 @@ void Pak::readEntries() {
 		debug(DBG_PAK, "Pak::readEntries() buf '%s' size %d", e->name, e->size);
 	}
 	qsort(_entries, _entriesCount, sizeof(PakEntry), comparePakEntry);
+	buildHashTable();
 	// the original executable descrambles the (ke)y.txt file and check the last 4 bytes.
 	// this has been disabled in later re-releases and a key is bundled in the data files
 	if (0) {
@@ -95,32 +120,102 @@ void Pak::readEntries() {
 	}
 }
 
+void Pak::buildHashTable() {
+	// open addressing, the table is at least twice as large as the number of entries
+	uint32_t size = 16;
+	while (size < uint32_t(_entriesCount) * 2) {
+		size *= 2;
+	}
+	_hashTable = (int *)calloc(size, sizeof(int));
+	if (!_hashTable) {
+		return;
+	}
+	_hashMask = size - 1;
+	for (int i = 0; i < _entriesCount; ++i) {
+		if (_entries[i].name[0] == 0) {
+			continue;
+		}
+		uint32_t h = hashName(_entries[i].name) & _hashMask;
+		while (_hashTable[h] != 0) {
+			h = (h + 1) & _hashMask;
+		}
+		_hashTable[h] = i + 1;
+	}
+}
+
 const PakEntry *Pak::find(const char *name) {
 	debug(DBG_PAK, "Pak::find() '%s'", name);
-	PakEntry tmp;
-	strcpy(tmp.name, name);
-	return (const PakEntry *)bsearch(&tmp, _entries, _entriesCount, sizeof(PakEntry), comparePakEntry);
+	if (!_hashTable) {
+		return 0;
+	}
+	for (uint32_t h = hashName(name) & _hashMask; _hashTable[h] != 0; h = (h + 1) & _hashMask) {
+		const PakEntry *e = &_entries[_hashTable[h] - 1];
+		if (strcasecmp(e->name, name) == 0) {
+			return e;
+		}
+	}
+	return 0;
+}
+
+static void getCacheName(int num, char *name, int size) {
+	snprintf(name, size, "pak_%03d", num);
+}
+
+uint8_t *Pak::borrowData(const PakEntry *e, uint32_t *size) {
+	uint8_t *p = _f.borrow(e->offset, e->size);
+	if (p && e->size > 5 && memcmp(p, "TooDC", 5) == 0) {
+		// encoded data is decoded to a copy, unless already in the disk cache
+		char name[16];
+		getCacheName(e - _entries, name, sizeof(name));
+		uint32_t cachedSize;
+		p = DiskCache::lookup(name, _f, &cachedSize);
+		if (p && e->size >= 10 && cachedSize == e->size - 10) {
+			*size = cachedSize;
+			return p;
+		}
+		return 0;
+	}
+	if (p) {
+		*size = e->size;
+	}
+	return p;
 }
 
 void Pak::loadData(const PakEntry *e, uint8_t *buf, uint32_t *size) {
 	debug(DBG_PAK, "Pak::loadData() %d bytes from 0x%x", e->size, e->offset);
-	_f.seek(e->offset);
-	if (_f.ioErr()) {
-		*size = 0;
-		return;
+	char name[16];
+	getCacheName(e - _entries, name, sizeof(name));
+	// the encoded data is decoded from the mapped file straight to buf
+	const uint8_t *data = _f.borrow(e->offset, e->size);
+	if (!data) {
+		if (_f.readAt(e->offset, buf, e->size) != (int)e->size) {
+			warning("Failed to read %d bytes from 0x%x", e->size, e->offset);
+			*size = 0;
+			return;
+		}
+		data = buf;
 	}
-	_f.read(buf, e->size);
-	if (e->size > 5 && memcmp(buf, "TooDC", 5) == 0) {
+	if (e->size >= 10 && memcmp(data, "TooDC", 5) == 0) {
 		const int dataSize = e->size - 6;
 		debug(DBG_PAK, "Pak::loadData() encoded TooDC data, size %d", dataSize);
+		uint32_t cachedSize;
+		const uint8_t *p = DiskCache::lookup(name, _f, &cachedSize);
+		if (p && cachedSize == uint32_t(dataSize - 4)) {
+			memcpy(buf, p, cachedSize);
+			*size = cachedSize;
+			return;
+		}
 		if ((dataSize & 3) != 0) {
 			// descrambler operates on uint32_t
 			warning("Unexpected size %d for encoded TooDC data '%s'", dataSize, e->name);
 		}
 		*size = dataSize - 4;
-		decode_toodc(buf + 6, (dataSize + 3) / 4);
-		memmove(buf, buf + 10, dataSize - 4);
+		decode_toodc(data + 6, buf, dataSize);
+		DiskCache::store(name, _f, buf, *size);
 	} else {
+		if (data != buf) {
+			memcpy(buf, data, e->size);
+		}
 		*size = e->size;
 	}
 }
@@ -17,6 +17,8 @@ struct Pak {
 	File _f;
 	PakEntry *_entries;
 	int _entriesCount;
+	int *_hashTable; // index + 1 of the entry, 0 if the slot is empty
+	uint32_t _hashMask;
 
 	Pak();
 	~Pak();
@@ -25,7 +27,9 @@ struct Pak {
 	void close();
 
 	void readEntries();
+	void buildHashTable();
 	const PakEntry *find(const char *name);
+	uint8_t *borrowData(const PakEntry *e, uint32_t *size);
 	void loadData(const PakEntry *e, uint8_t *buf, uint32_t *size);
 };
 
@@ -4,8 +4,12 @@
  * Copyright (C) 2004-2005 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <pthread.h>
 #include "resource.h"
+#include "diskcache.h"
 #include "file.h"
+#include "graphics.h"
+#include "loadtrace.h"
 #include "pak.h"
 #include "resource_nth.h"
 #include "resource_win31.h"
@@ -16,8 +20,139 @@
 
 static const char *atariDemo = "aw.tos";
 
+// single file holding the unpacked resources of a data set, indexed by resource number
+static const char *kPackName = "rawgl.pack";
+static const uint32_t kPackTag = 0x50574152; // 'RAWP'
+static const uint32_t kPackVersion = 2;
+static const int kPackHeaderSize = 24;
+static const int kPackIndexSize = Resource::ENTRIES_COUNT_20TH * 8;
+static const int kPackAlign = 16;
+
+struct PrefetchSegment {
+	int num;
+	File *f;
+	bool ownFile;
+	uint32_t offset;
+	uint32_t packedSize;
+	uint32_t unpackedSize;
+	uint8_t *data;
+};
+
+// segments of the next game part, read and unpacked by a worker thread
+struct PartPrefetch {
+	pthread_t thread;
+	bool running;
+	int part;
+	PrefetchSegment segments[4];
+	int segmentsCount;
+};
+
+static void *prefetchProc(void *arg) {
+	PartPrefetch *pp = (PartPrefetch *)arg;
+	for (int i = 0; i < pp->segmentsCount; ++i) {
+		PrefetchSegment *seg = &pp->segments[i];
+		const uint32_t size = (seg->unpackedSize > seg->packedSize) ? seg->unpackedSize : seg->packedSize;
+		seg->data = (uint8_t *)malloc(size);
+		if (!seg->data) {
+			continue;
+		}
+		bool ret = (seg->f->readAt(seg->offset, seg->data, seg->packedSize) == (int)seg->packedSize);
+		if (ret && seg->packedSize != seg->unpackedSize) {
+			ret = bytekiller_unpack(seg->data, seg->unpackedSize, seg->data, seg->packedSize);
+		}
+		if (!ret) {
+			free(seg->data);
+			seg->data = 0;
+		}
+	}
+	return 0;
+}
+
+static int getNextPart(int part) {
+	switch (part) {
+	case kPartCopyProtection:
+	case kPartIntro:
+	case kPartWater:
+	case kPartPrison:
+	case kPartCite:
+	case kPartArene:
+	case kPartLuxe:
+		return part + 1;
+	}
+	return -1;
+}
+
+static const uint32_t kArenaBlockSize = 256 * 1024;
+
+MemArena::MemArena()
+	: _current(0), _used(0), _size(0), _highWater(0) {
+}
+
+MemArena::~MemArena() {
+	release();
+}
+
+uint8_t *MemArena::reserve(uint32_t size) {
+	while (_current < (int)_blocks.size()) {
+		if (size <= _blocks[_current].size - _used) {
+			return _blocks[_current].ptr + _used;
+		}
+		++_current;
+		_used = 0;
+	}
+	MemBlock b;
+	b.size = MAX(size, kArenaBlockSize);
+	b.ptr = (uint8_t *)malloc(b.size);
+	if (!b.ptr) {
+		warning("Unable to allocate %d bytes", b.size);
+		return 0;
+	}
+	_blocks.push_back(b);
+	_current = _blocks.size() - 1;
+	_used = 0;
+	return b.ptr;
+}
+
+void MemArena::commit(uint32_t size) {
+	_used += size;
+	_size += size;
+	if (_size > _highWater) {
+		_highWater = _size;
+	}
+}
+
+uint8_t *MemArena::alloc(uint32_t size) {
+	uint8_t *p = reserve(size);
+	if (p) {
+		commit(size);
+	}
+	return p;
+}
+
+void MemArena::reset() {
+	_current = 0;
+	_used = 0;
+	_size = 0;
+}
+
+void MemArena::release() {
+	for (size_t i = 0; i < _blocks.size(); ++i) {
+		free(_blocks[i].ptr);
+	}
+	_blocks.clear();
+	reset();
+}
+
+uint32_t MemArena::capacity() const {
+	uint32_t size = 0;
+	for (size_t i = 0; i < _blocks.size(); ++i) {
+		size += _blocks[i].size;
+	}
+	return size;
+}
+
 Resource::Resource(Video *vid, const char *dataDir)
-	: _vid(vid), _dataDir(dataDir), _currentPart(0), _nextPart(0), _dataType(DT_DOS), _nth(0), _win31(0), _3do(0) {
+	: _vid(vid), _dataDir(dataDir), _currentPart(0), _nextPart(0), _tracePart(0), _traceRequest(0), _dataType(DT_DOS), _nth(0), _win31(0), _3do(0) {
 	_bankPrefix = "bank";
 	_hasPasswordScreen = true;
 	memset(_memList, 0, sizeof(_memList));
@@ -28,27 +163,95 @@ Resource::Resource(Video *vid, const char *dataDir)
 	_lang = LANG_FR;
 	_amigaMemList = 0;
 	memset(&_demo3Joy, 0, sizeof(_demo3Joy));
+	memset(_bankFiles, 0, sizeof(_bankFiles));
+	_prefetch = new PartPrefetch;
+	memset(_prefetch, 0, sizeof(PartPrefetch));
+	_prefetch->part = -1;
+	_packFile = 0;
+	for (int i = 0; i < PARTS_COUNT; ++i) {
+		memset(_partsMem[i].segments, 0, sizeof(_partsMem[i].segments));
+		_partsMem[i].resident = false;
+		_partsMem[i].lastUse = 0;
+	}
+	_curArena = &_resArena;
+	_partsCounter = 0;
+	_bitmapBuf = 0;
+	_bitmapBufSize = 0;
+	_segCodeSize = 0;
 }
 
 Resource::~Resource() {
+	stopPrefetch();
+	delete _prefetch;
 	free(_demo3Joy.bufPtr);
+	for (int i = 0; i < 256; ++i) {
+		delete _bankFiles[i];
+	}
 	delete _nth;
 	delete _win31;
 	delete _3do;
+	DiskCache::clear();
+	delete _packFile;
+	free(_bitmapBuf);
 }
 
-bool Resource::readBank(const MemEntry *me, uint8_t *dstBuf) {
-	bool ret = false;
+bool Resource::openBank(File &f, int bankNum) {
 	char name[10];
-	snprintf(name, sizeof(name), "%s%02x", _bankPrefix, me->bankNum);
-	File f;
-	if (f.open(name, _dataDir) || (_dataType == DT_ATARI_DEMO && f.open(atariDemo, _dataDir))) {
-		f.seek(me->bankPos);
-		const size_t count = f.read(dstBuf, me->packedSize);
-		ret = (count == me->packedSize);
-		if (ret && me->packedSize != me->unpackedSize) {
-			ret = bytekiller_unpack(dstBuf, me->unpackedSize, dstBuf, me->packedSize);
+	snprintf(name, sizeof(name), "%s%02x", _bankPrefix, bankNum);
+	return f.openMmap(name, _dataDir) || (_dataType == DT_ATARI_DEMO && f.openMmap(atariDemo, _dataDir));
+}
+
+File *Resource::getBankFile(int bankNum) {
+	// the bank files stay mapped, uncompressed entries are used in place
+	if (!_bankFiles[bankNum]) {
+		File *f = new File;
+		if (!openBank(*f, bankNum)) {
+			delete f;
+			return 0;
 		}
+		_bankFiles[bankNum] = f;
+	}
+	return _bankFiles[bankNum];
+}
+
+bool Resource::readBank(const MemEntry *me, uint8_t *dstBuf) {
+	File *f = getBankFile(me->bankNum);
+	return f && readBankEntry(*f, me, dstBuf);
+}
+
+static void getCacheName(int num, char *name, int size) {
+	snprintf(name, size, "data_%02x", num);
+}
+
+uint8_t *Resource::mapEntry(File &f, const MemEntry *me) {
+	uint32_t size;
+	uint8_t *p = findPackEntry(me - _memList, &size);
+	if (p && size == me->unpackedSize) {
+		return p;
+	}
+	if (me->packedSize == me->unpackedSize) {
+		return f.borrow(me->bankPos, me->packedSize);
+	}
+	// packed entries can be found unpacked in the disk cache
+	char name[16];
+	getCacheName(me - _memList, name, sizeof(name));
+	p = DiskCache::lookup(name, f, &size);
+	return (p && size == me->unpackedSize) ? p : 0;
+}
+
+void Resource::storeEntry(File &f, const MemEntry *me, const uint8_t *data) {
+	if (me->packedSize != me->unpackedSize) {
+		char name[16];
+		getCacheName(me - _memList, name, sizeof(name));
+		DiskCache::store(name, f, data, me->unpackedSize);
+	}
+}
+
+bool Resource::readBankEntry(File &f, const MemEntry *me, uint8_t *dstBuf) {
+	const uint32_t count = f.readAt(me->bankPos, dstBuf, me->packedSize);
+	bool ret = (count == me->packedSize);
+	if (ret && me->packedSize != me->unpackedSize) {
+		ret = bytekiller_unpack(dstBuf, me->unpackedSize, dstBuf, me->packedSize);
 	}
 	return ret;
 }
@@ -127,6 +330,199 @@ void Resource::detectVersion() {
 	} else {
 		error("No data files found in '%s'", _dataDir);
 	}
+	DiskCache::setDataSet(_dataDir, _dataType);
+}
+
+void Resource::getPackEntries(bool *pending) {
+	// the game parts segments for all versions, every memlist entry for the 1991 versions
+	memset(pending, 0, sizeof(bool) * ENTRIES_COUNT_20TH);
+	switch (_dataType) {
+	case DT_DOS:
+	case DT_AMIGA:
+	case DT_ATARI:
+	case DT_ATARI_DEMO:
+		for (int i = 0; i < _numMemList; ++i) {
+			pending[i] = (_memList[i].bankNum != 0 && _memList[i].unpackedSize != 0);
+		}
+		break;
+	default:
+		for (int part = kPartCopyProtection; part <= kPartPassword; ++part) {
+			for (int i = 0; i < 4; ++i) {
+				pending[_memListParts[part - 16000][i]] = true;
+			}
+		}
+		pending[0] = false;
+		break;
+	}
+}
+
+void Resource::getPackStamp(uint32_t *size, uint32_t *mtime) {
+	// sizes and modification times of the files the entries are read from, as for the disk cache entries
+	*size = *mtime = 0;
+	bool pending[ENTRIES_COUNT_20TH];
+	getPackEntries(pending);
+	for (int num = 0; num < _numMemList; ++num) {
+		if (!pending[num]) {
+			continue;
+		}
+		File f;
+		File *src = 0;
+		uint32_t offset, dataSize;
+		switch (_dataType) {
+		case DT_15TH_EDITION:
+		case DT_20TH_EDITION:
+			src = _nth->getDataFile();
+			if (!src && _nth->openDat(num, f)) {
+				src = &f;
+			}
+			break;
+		case DT_WIN31:
+			src = &_win31->_f;
+			break;
+		case DT_3DO:
+			src = _3do->openFile(num, f, &offset, &dataSize);
+			break;
+		default:
+			src = getBankFile(_memList[num].bankNum);
+			break;
+		}
+		if (src) {
+			*size += src->size();
+			*mtime = MAX(*mtime, src->mtime());
+		}
+	}
+}
+
+bool Resource::openPack() {
+	File *f = new File;
+	if (!f->openMmap(kPackName, _dataDir, false)) {
+		delete f;
+		return false;
+	}
+	uint32_t size, mtime;
+	getPackStamp(&size, &mtime);
+	const uint8_t *hdr = f->borrow(0, kPackHeaderSize + kPackIndexSize);
+	if (!hdr || READ_LE_UINT32(hdr) != kPackTag || READ_LE_UINT32(hdr + 4) != kPackVersion || READ_LE_UINT32(hdr + 8) != (uint32_t)_dataType || READ_LE_UINT32(hdr + 12) != ENTRIES_COUNT_20TH
+		|| READ_LE_UINT32(hdr + 16) != size || READ_LE_UINT32(hdr + 20) != mtime) {
+		warning("Ignoring '%s', not matching the data files", kPackName);
+		delete f;
+		return false;
+	}
+	debug(DBG_INFO, "Using resources from '%s'", kPackName);
+	_packFile = f;
+	return true;
+}
+
+uint8_t *Resource::findPackEntry(int num, uint32_t *size) {
+	if (!_packFile || num >= ENTRIES_COUNT_20TH) {
+		return 0;
+	}
+	const uint8_t *p = _packFile->borrow(kPackHeaderSize + num * 8, 8);
+	const uint32_t offset = READ_LE_UINT32(p);
+	*size = READ_LE_UINT32(p + 4);
+	return (*size != 0) ? _packFile->borrow(offset, *size) : 0;
+}
+
+bool Resource::writePack(const char *path) {
+	bool pending[ENTRIES_COUNT_20TH];
+	getPackEntries(pending);
+	File f;
+	if (!f.openForWriting(path)) {
+		warning("Unable to open '%s' for writing", path);
+		return false;
+	}
+	// sized for each entry, the loaders do not check the destination size
+	uint8_t *buf = 0;
+	uint32_t bufSize = 0;
+	uint8_t index[kPackIndexSize];
+	memset(index, 0, sizeof(index));
+	f.write(index, kPackHeaderSize);
+	f.write(index, kPackIndexSize);
+	uint32_t offset = kPackHeaderSize + kPackIndexSize;
+	int count = 0;
+	for (int num = 0; num < _numMemList; ++num) {
+		if (!pending[num]) {
+			continue;
+		}
+		uint32_t datSize = getDatSize(num);
+		switch (_dataType) {
+		case DT_DOS:
+		case DT_AMIGA:
+		case DT_ATARI:
+		case DT_ATARI_DEMO:
+			// the bank data is read before being unpacked in place
+			datSize = MAX(_memList[num].packedSize, _memList[num].unpackedSize);
+			break;
+		default:
+			break;
+		}
+		if (datSize == 0) {
+			warning("Unable to read resource %d", num);
+			continue;
+		}
+		if (datSize > bufSize) {
+			uint8_t *tmp = (uint8_t *)realloc(buf, datSize);
+			if (!tmp) {
+				warning("Unable to allocate %d bytes", datSize);
+				free(buf);
+				return false;
+			}
+			buf = tmp;
+			bufSize = datSize;
+		}
+		uint32_t size = 0;
+		uint8_t *p = 0;
+		switch (_dataType) {
+		case DT_15TH_EDITION:
+		case DT_20TH_EDITION:
+			p = _nth->loadDat(num, buf, &size);
+			break;
+		case DT_WIN31:
+			p = _win31->loadFile(num, buf, &size);
+			break;
+		case DT_3DO:
+			p = _3do->loadFile(num, buf, &size);
+			break;
+		default:
+			if (readBank(&_memList[num], buf)) {
+				p = buf;
+				size = _memList[num].unpackedSize;
+			}
+			break;
+		}
+		if (!p || size == 0) {
+			warning("Unable to read resource %d", num);
+			continue;
+		}
+		const uint32_t padding = (kPackAlign - (offset & (kPackAlign - 1))) & (kPackAlign - 1);
+		if (padding != 0) {
+			static const uint8_t zero[kPackAlign] = { 0 };
+			f.write((void *)zero, padding);
+			offset += padding;
+		}
+		f.write(p, size);
+		WRITE_LE_UINT32(index + num * 8, offset);
+		WRITE_LE_UINT32(index + num * 8 + 4, size);
+		offset += size;
+		++count;
+	}
+	free(buf);
+	f.seek(0);
+	f.writeUint32LE(kPackTag);
+	f.writeUint32LE(kPackVersion);
+	f.writeUint32LE(_dataType);
+	f.writeUint32LE(ENTRIES_COUNT_20TH);
+	uint32_t srcSize, srcMtime;
+	getPackStamp(&srcSize, &srcMtime);
+	f.writeUint32LE(srcSize);
+	f.writeUint32LE(srcMtime);
+	f.write(index, kPackIndexSize);
+	if (f.ioErr()) {
+		warning("Failed to write '%s'", path);
+		return false;
+	}
+	debug(DBG_INFO, "Wrote %d resources (%d bytes) to '%s'", count, offset, path);
+	return true;
 }
 
 static const char *kGameTitleEU = "Another World";
@@ -284,60 +680,117 @@ void Resource::dumpEntries() {
 	}
 }
 
-void Resource::load() {
-	while (1) {
-		MemEntry *me = 0;
-
-		// get resource with max rankNum
-		uint8_t maxNum = 0;
+void Resource::loadResident() {
+	if (!File::_resident) {
+		return;
+	}
+	switch (_dataType) {
+	case DT_AMIGA:
+	case DT_ATARI:
+	case DT_ATARI_DEMO:
+	case DT_DOS:
 		for (int i = 0; i < _numMemList; ++i) {
-			MemEntry *it = &_memList[i];
-			if (it->status == STATUS_TOLOAD && maxNum <= it->rankNum) {
-				maxNum = it->rankNum;
-				me = it;
+			if (_memList[i].bankNum != 0) {
+				getBankFile(_memList[i].bankNum);
 			}
 		}
-		if (me == 0) {
-			break; // no entry found
+		break;
+	default:
+		// the other data sets are opened when reading the entries
+		break;
+	}
+	uint32_t unpackedSize = 0;
+	for (int i = 0; i < _numMemList; ++i) {
+		unpackedSize += getDatSize(i);
+	}
+	debug(DBG_INFO, "Resident data %d KB, unpacked resources %d KB", File::getResidentSize() / 1024, unpackedSize / 1024);
+}
+
+static int compareLoadEntries(const void *a, const void *b) {
+	const MemEntry *me1 = *(const MemEntry **)a;
+	const MemEntry *me2 = *(const MemEntry **)b;
+	if (me1->rankNum != me2->rankNum) {
+		return me2->rankNum - me1->rankNum;
+	}
+	if (me1->bankNum != me2->bankNum) {
+		return me1->bankNum - me2->bankNum;
+	}
+	if (me1->bankPos != me2->bankPos) {
+		return (me1->bankPos < me2->bankPos) ? -1 : 1;
+	}
+	return (me1 < me2) ? -1 : 1;
+}
+
+void Resource::load() {
+	// collect the pending entries, highest rank first then in bank order
+	MemEntry *entries[ENTRIES_COUNT_20TH];
+	int count = 0;
+	for (int i = 0; i < _numMemList; ++i) {
+		if (_memList[i].status == STATUS_TOLOAD) {
+			entries[count++] = &_memList[i];
 		}
+	}
+	qsort(entries, count, sizeof(MemEntry *), compareLoadEntries);
+
+	for (int i = 0; i < count; ++i) {
+		MemEntry *me = entries[i];
 
 		const int resourceNum = me - _memList;
+		LoadTraceScope trace("mem", resourceNum, _tracePart, _traceRequest);
 
-		uint8_t *memPtr = 0;
-		if (me->type == RT_BITMAP) {
-			memPtr = _vidCurPtr;
-		} else {
-			memPtr = _scriptCurPtr;
-			const uint32_t avail = uint32_t(_vidCurPtr - _scriptCurPtr);
-			if (me->unpackedSize > avail) {
-				warning("Resource::load() not enough memory, available=%d", avail);
-				me->status = STATUS_NULL;
-				continue;
-			}
+		if (me->type == RT_BITMAP && _vid->drawCachedBitmap(resourceNum)) {
+			me->status = STATUS_NULL;
+			continue;
 		}
 		if (me->bankNum == 0) {
 			warning("Resource::load() ec=0x%X (me->bankNum == 0)", 0xF00);
 			me->status = STATUS_NULL;
-		} else {
-			debug(DBG_BANK, "Resource::load() bufPos=0x%X size=%d type=%d pos=0x%X bankNum=%d", memPtr - _memPtrStart, me->packedSize, me->type, me->bankPos, me->bankNum);
-			if (readBank(me, memPtr)) {
+			continue;
+		}
+		File *f = getBankFile(me->bankNum);
+		if (f) {
+			uint8_t *p = mapEntry(*f, me);
+			if (p) {
+				debug(DBG_BANK, "Resource::load() mapped size=%d type=%d pos=0x%X bankNum=%d", me->unpackedSize, me->type, me->bankPos, me->bankNum);
+				trace._size = me->unpackedSize;
 				if (me->type == RT_BITMAP) {
-					_vid->copyBitmapPtr(_vidCurPtr, me->unpackedSize);
+					_vid->copyBitmapPtr(p, me->unpackedSize, resourceNum);
 					me->status = STATUS_NULL;
 				} else {
-					me->bufPtr = memPtr;
+					me->bufPtr = p;
 					me->status = STATUS_LOADED;
-					_scriptCurPtr += me->unpackedSize;
 				}
+				continue;
+			}
+		}
+
+		// the packed data is read first and unpacked in place
+		const uint32_t size = MAX(me->packedSize, me->unpackedSize);
+		uint8_t *memPtr = (me->type == RT_BITMAP) ? getBitmapBuffer(size) : _curArena->reserve(size);
+		if (!memPtr) {
+			me->status = STATUS_NULL;
+			continue;
+		}
+		debug(DBG_BANK, "Resource::load() size=%d type=%d pos=0x%X bankNum=%d", me->packedSize, me->type, me->bankPos, me->bankNum);
+		if (f && readBankEntry(*f, me, memPtr)) {
+			storeEntry(*f, me, memPtr);
+			trace._size = me->unpackedSize;
+			if (me->type == RT_BITMAP) {
+				_vid->copyBitmapPtr(memPtr, me->unpackedSize, resourceNum);
+				me->status = STATUS_NULL;
 			} else {
-				if (_dataType == DT_DOS && me->bankNum == 12 && me->type == RT_BANK) {
-					// DOS demo version does not have the bank for this resource
-					// this should be safe to ignore as the resource does not appear to be used by the game code
-					me->status = STATUS_NULL;
-					continue;
-				}
-				error("Unable to read resource %d from bank %d", resourceNum, me->bankNum);
+				_curArena->commit(me->unpackedSize);
+				me->bufPtr = memPtr;
+				me->status = STATUS_LOADED;
 			}
+		} else {
+			if (_dataType == DT_DOS && me->bankNum == 12 && me->type == RT_BANK) {
+				// DOS demo version does not have the bank for this resource
+				// this should be safe to ignore as the resource does not appear to be used by the game code
+				me->status = STATUS_NULL;
+				continue;
+			}
+			error("Unable to read resource %d from bank %d", resourceNum, me->bankNum);
 		}
 	}
 }
@@ -349,7 +802,7 @@ void Resource::invalidateRes() {
 			me->status = STATUS_NULL;
 		}
 	}
-	_scriptCurPtr = _scriptBakPtr;
+	_resArena.reset();
 	_vid->_currentPal = 0xFF;
 }
 
@@ -357,7 +810,7 @@ void Resource::invalidateAll() {
 	for (int i = 0; i < _numMemList; ++i) {
 		_memList[i].status = STATUS_NULL;
 	}
-	_scriptCurPtr = _memPtrStart;
+	_resArena.reset();
 	_vid->_currentPal = 0xFF;
 }
 
@@ -413,6 +866,7 @@ void Resource::update(uint16_t num, PreloadSoundProc preloadSound, void *data) {
 		_nextPart = num;
 		return;
 	}
+	_traceRequest = num;
 	switch (_dataType) {
 	case DT_15TH_EDITION:
 	case DT_20TH_EDITION:
@@ -463,24 +917,49 @@ void Resource::update(uint16_t num, PreloadSoundProc preloadSound, void *data) {
 }
 
 void Resource::loadBmp(int num) {
+	if (_vid->drawCachedBitmap(num)) {
+		return;
+	}
+	LoadTraceScope trace("bmp", num, _tracePart, _traceRequest);
 	uint32_t size = 0;
 	uint8_t *p = 0;
 	switch (_dataType) {
 	case DT_15TH_EDITION:
 	case DT_20TH_EDITION:
+		if (!Graphics::_is1991) {
+			int w, h;
+			p = _nth->loadBmpRGB(num, &w, &h);
+			if (p) {
+				trace._size = w * h * 3;
+				_vid->copyBitmapRGB(p, w, h, num);
+				free(p);
+			}
+			return;
+		}
 		p = _nth->loadBmp(num);
 		break;
 	case DT_WIN31:
 		p = _win31->loadFile(num, 0, &size);
 		break;
-	case DT_3DO:
-		p = _3do->loadFile(num, 0, &size);
-		break;
+	case DT_3DO: {
+			// decode to the bitmap buffer, no allocation for each bitmap
+			uint8_t *buf = getBitmapBuffer(_3do->getFileSize(num));
+			if (buf) {
+				p = _3do->loadFile(num, buf, &size);
+				if (p) {
+					trace._size = size;
+					_vid->copyBitmapPtr(p, size, num);
+				}
+			}
+		}
+		return;
 	default:
 		break;
 	}
 	if (p) {
-		_vid->copyBitmapPtr(p, size);
+		// the anniversary editions return a .bmp file
+		trace._size = (size == 0 && memcmp(p, "BM", 2) == 0) ? READ_LE_UINT32(p + 2) : size;
+		_vid->copyBitmapPtr(p, size, num);
 		free(p);
 	}
 }
@@ -490,24 +969,35 @@ uint8_t *Resource::loadDat(int num) {
 	if (_memList[num].status == STATUS_LOADED) {
 		return _memList[num].bufPtr;
 	}
+	LoadTraceScope trace("dat", num, _tracePart, _traceRequest);
 	uint32_t size = 0;
-	uint8_t *p = 0;
-	switch (_dataType) {
-	case DT_15TH_EDITION:
-	case DT_20TH_EDITION:
-		p = _nth->loadDat(num, _scriptCurPtr, &size);
-		break;
-	case DT_WIN31:
-		p = _win31->loadFile(num, _scriptCurPtr, &size);
-		break;
-	case DT_3DO:
-		p = _3do->loadFile(num, _scriptCurPtr, &size);
-		break;
-	default:
-		break;
+	uint8_t *p = findPackEntry(num, &size);
+	if (!p) {
+		uint8_t *dst = _curArena->reserve(getDatSize(num));
+		if (!dst) {
+			return 0;
+		}
+		switch (_dataType) {
+		case DT_15TH_EDITION:
+		case DT_20TH_EDITION:
+			p = _nth->loadDat(num, dst, &size);
+			break;
+		case DT_WIN31:
+			p = _win31->loadFile(num, dst, &size);
+			break;
+		case DT_3DO:
+			p = _3do->loadFile(num, dst, &size);
+			break;
+		default:
+			break;
+		}
+		// data not copied to the arena is borrowed from a mapped file
+		if (p == dst) {
+			_curArena->commit(size);
+		}
 	}
 	if (p) {
-		_scriptCurPtr += size;
+		trace._size = size;
 		_memList[num].bufPtr = p;
 		_memList[num].status = STATUS_LOADED;
 	}
@@ -534,25 +1024,39 @@ void Resource::loadHeads() {
 	}
 }
 
-uint8_t *Resource::loadWav(int num) {
+uint8_t *Resource::loadWav(int num, int **ref) {
+	*ref = 0;
 	if (_memList[num].status == STATUS_LOADED) {
 		return _memList[num].bufPtr;
 	}
+	LoadTraceScope trace("wav", num, _tracePart, _traceRequest);
 	uint32_t size = 0;
 	uint8_t *p = 0;
+	uint8_t *dst = 0;
 	switch (_dataType) {
 	case DT_15TH_EDITION:
 	case DT_20TH_EDITION:
-		p = _nth->loadWav(num, _scriptCurPtr, &size);
+		// the sound is kept in the cache of the backend
+		p = _nth->loadWav(num, ref);
+		if (p && memcmp(p, "RIFF", 4) == 0) {
+			trace._size = READ_LE_UINT32(p + 4) + 8;
+		}
 		break;
 	case DT_WIN31:
-		p = _win31->loadFile(num, _scriptCurPtr, &size);
+		dst = _curArena->reserve(getDatSize(num));
+		if (dst) {
+			p = _win31->loadFile(num, dst, &size);
+		}
 		break;
 	default:
 		break;
 	}
 	if (p && size != 0) {
-		_scriptCurPtr += size;
+		trace._size = size;
+		// data not copied to the arena is mapped from the disk cache
+		if (p == dst) {
+			_curArena->commit(size);
+		}
 		_memList[num].bufPtr = p;
 		_memList[num].status = STATUS_LOADED;
 	}
@@ -613,6 +1117,8 @@ const uint8_t Resource::_memListParts[][4] = {
 };
 
 void Resource::setupPart(int ptrId) {
+	_tracePart = ptrId;
+	_traceRequest = 0;
 	int firstPart = kPartCopyProtection;
 	switch (_dataType) {
 	case DT_15TH_EDITION:
@@ -623,22 +1129,35 @@ void Resource::setupPart(int ptrId) {
 	case DT_WIN31:
 		if (ptrId >= firstPart && ptrId <= 16009) {
 			invalidateAll();
+			const bool resident = restorePart(ptrId);
+			if (!resident) {
+				beginPart(ptrId);
+			}
 			uint8_t **segments[4] = { &_segVideoPal, &_segCode, &_segVideo1, &_segVideo2 };
 			for (int i = 0; i < 4; ++i) {
 				const int num = _memListParts[ptrId - 16000][i];
 				if (num != 0) {
+					if (resident) {
+						*segments[i] = _memList[num].bufPtr;
+						continue;
+					}
 					if (_dataType == DT_20TH_EDITION && 0) {
 						// HD assets
 						_nth->preloadDat(ptrId - 16000, i, num);
 					}
-					*segments[i] = loadDat(num);
+					*segments[i] = commitPrefetch(num);
+					if (!*segments[i]) {
+						*segments[i] = loadDat(num);
+					}
 				}
 			}
+			if (!resident) {
+				endPart(ptrId);
+			}
 			_currentPart = ptrId;
 		} else {
 			error("Resource::setupPart() ec=0x%X invalid part", 0xF07);
 		}
-		_scriptBakPtr = _scriptCurPtr;
 		break;
 	case DT_AMIGA:
 	case DT_ATARI:
@@ -659,13 +1178,17 @@ void Resource::setupPart(int ptrId) {
 				error("Resource::setupPart() ec=0x%X invalid part", 0xF07);
 			}
 			invalidateAll();
-			_memList[ipal].status = STATUS_TOLOAD;
-			_memList[icod].status = STATUS_TOLOAD;
-			_memList[ivd1].status = STATUS_TOLOAD;
-			if (ivd2 != 0) {
-				_memList[ivd2].status = STATUS_TOLOAD;
+			if (!restorePart(ptrId)) {
+				beginPart(ptrId);
+				const uint8_t nums[4] = { ipal, icod, ivd1, ivd2 };
+				for (int i = 0; i < 4; ++i) {
+					if (nums[i] != 0 && !commitPrefetch(nums[i])) {
+						_memList[nums[i]].status = STATUS_TOLOAD;
+					}
+				}
+				load();
+				endPart(ptrId);
 			}
-			load();
 			_segVideoPal = _memList[ipal].bufPtr;
 			_segCode = _memList[icod].bufPtr;
 			_segVideo1 = _memList[ivd1].bufPtr;
@@ -674,21 +1197,225 @@ void Resource::setupPart(int ptrId) {
 			}
 			_currentPart = ptrId;
 		}
-		_scriptBakPtr = _scriptCurPtr;
 		break;
 	}
+	_segCodeSize = getDatSize(_memListParts[ptrId - 16000][1]);
+	startPrefetch(getNextPart(ptrId));
+}
+
+bool Resource::restorePart(int part) {
+	PartMem *pm = &_partsMem[part - 16000];
+	if (!pm->resident) {
+		return false;
+	}
+	for (int i = 0; i < 4; ++i) {
+		const int num = _memListParts[part - 16000][i];
+		if (num != 0) {
+			_memList[num].bufPtr = pm->segments[i];
+			_memList[num].status = STATUS_LOADED;
+		}
+	}
+	pm->lastUse = ++_partsCounter;
+	debug(DBG_RESOURCE, "Using resident part %d", part);
+	return true;
+}
+
+void Resource::beginPart(int part) {
+	// the segments are allocated in the arena of the part
+	PartMem *pm = &_partsMem[part - 16000];
+	pm->arena.reset();
+	_curArena = &pm->arena;
+}
+
+void Resource::endPart(int part) {
+	PartMem *pm = &_partsMem[part - 16000];
+	pm->resident = true;
+	for (int i = 0; i < 4; ++i) {
+		const int num = _memListParts[part - 16000][i];
+		if (num != 0) {
+			if (_memList[num].status != STATUS_LOADED) {
+				pm->resident = false;
+			}
+			pm->segments[i] = _memList[num].bufPtr;
+		}
+	}
+	pm->lastUse = ++_partsCounter;
+	_curArena = &_resArena;
+	debug(DBG_RESOURCE, "Part %d uses %d bytes (high water %d)", part, pm->arena._size, pm->arena._highWater);
+	// release the least recently used parts over the memory budget
+	while (1) {
+		uint32_t size = 0;
+		PartMem *lru = 0;
+		for (int i = 0; i < PARTS_COUNT; ++i) {
+			PartMem *p = &_partsMem[i];
+			size += p->arena.capacity();
+			if (p != pm && !p->arena._blocks.empty() && (!lru || p->lastUse < lru->lastUse)) {
+				lru = p;
+			}
+		}
+		if (size <= MEM_RESIDENT_SIZE || !lru) {
+			break;
+		}
+		lru->arena.release();
+		lru->resident = false;
+	}
+}
+
+void Resource::startPrefetch(int part) {
+	if (_prefetch->part == part) {
+		return;
+	}
+	stopPrefetch();
+	if (part < 0 || _partsMem[part - 16000].resident) {
+		return;
+	}
+	PartPrefetch *pp = _prefetch;
+	pp->segmentsCount = 0;
+	for (int i = 0; i < 4; ++i) {
+		const int num = _memListParts[part - 16000][i];
+		if (num == 0) {
+			continue;
+		}
+		PrefetchSegment *seg = &pp->segments[pp->segmentsCount];
+		memset(seg, 0, sizeof(PrefetchSegment));
+		seg->num = num;
+		// the files are opened here, the worker only does positional reads
+		switch (_dataType) {
+		case DT_AMIGA:
+		case DT_ATARI:
+		case DT_ATARI_DEMO:
+		case DT_DOS: {
+				const MemEntry *me = &_memList[num];
+				seg->f = (me->bankNum != 0) ? getBankFile(me->bankNum) : 0;
+				if (!seg->f || mapEntry(*seg->f, me)) {
+					continue;
+				}
+				seg->offset = me->bankPos;
+				seg->packedSize = me->packedSize;
+				seg->unpackedSize = me->unpackedSize;
+			}
+			break;
+		case DT_20TH_EDITION:
+			if (findPackEntry(num, &seg->packedSize)) {
+				continue;
+			}
+			seg->f = new File;
+			seg->ownFile = true;
+			if (!_nth->openDat(num, *seg->f)) {
+				delete seg->f;
+				continue;
+			}
+			seg->packedSize = seg->unpackedSize = seg->f->size();
+			break;
+		default:
+			// Win31 and 3DO decoders read from shared files, 15th edition data is used in place
+			return;
+		}
+		++pp->segmentsCount;
+	}
+	if (pp->segmentsCount != 0) {
+		pp->part = part;
+		pp->running = (pthread_create(&pp->thread, 0, prefetchProc, pp) == 0);
+		if (!pp->running) {
+			warning("Failed to create prefetch thread");
+			stopPrefetch();
+		} else {
+			debug(DBG_RESOURCE, "Prefetching part %d", part);
+		}
+	}
+}
+
+void Resource::stopPrefetch() {
+	PartPrefetch *pp = _prefetch;
+	if (pp->running) {
+		pthread_join(pp->thread, 0);
+		pp->running = false;
+	}
+	for (int i = 0; i < pp->segmentsCount; ++i) {
+		PrefetchSegment *seg = &pp->segments[i];
+		free(seg->data);
+		if (seg->ownFile) {
+			delete seg->f;
+		}
+	}
+	pp->segmentsCount = 0;
+	pp->part = -1;
+}
+
+uint8_t *Resource::commitPrefetch(int num) {
+	PartPrefetch *pp = _prefetch;
+	if (pp->part < 0) {
+		return 0;
+	}
+	for (int i = 0; i < pp->segmentsCount; ++i) {
+		PrefetchSegment *seg = &pp->segments[i];
+		if (seg->num != num) {
+			continue;
+		}
+		if (pp->running) {
+			pthread_join(pp->thread, 0);
+			pp->running = false;
+		}
+		uint8_t *p = seg->data ? _curArena->alloc(seg->unpackedSize) : 0;
+		if (!p) {
+			return 0;
+		}
+		memcpy(p, seg->data, seg->unpackedSize);
+		if (!seg->ownFile) {
+			storeEntry(*seg->f, &_memList[num], p);
+		}
+		free(seg->data);
+		seg->data = 0;
+		_memList[num].bufPtr = p;
+		_memList[num].status = STATUS_LOADED;
+		return p;
+	}
+	return 0;
+}
+
+uint32_t Resource::getDatSize(int num) {
+	switch (_dataType) {
+	case DT_15TH_EDITION:
+	case DT_20TH_EDITION:
+		return _nth->getDatSize(num);
+	case DT_WIN31:
+		return _win31->getFileSize(num);
+	case DT_3DO:
+		return _3do->getFileSize(num);
+	default:
+		return _memList[num].unpackedSize;
+	}
+}
+
+uint8_t *Resource::getBitmapBuffer(uint32_t size) {
+	if (size > _bitmapBufSize) {
+		uint8_t *p = (uint8_t *)realloc(_bitmapBuf, size);
+		if (!p) {
+			warning("Unable to allocate %d bytes", size);
+			return 0;
+		}
+		_bitmapBuf = p;
+		_bitmapBufSize = size;
+	}
+	return _bitmapBuf;
 }
 
 void Resource::allocMemBlock() {
-	_memPtrStart = (uint8_t *)malloc(MEM_BLOCK_SIZE);
-	_scriptBakPtr = _scriptCurPtr = _memPtrStart;
-	_vidCurPtr = _memPtrStart + MEM_BLOCK_SIZE - (320 * 200 / 2); // 4bpp bitmap
+	_curArena = &_resArena;
+	getBitmapBuffer(320 * 200 / 2); // 4bpp bitmap
 	_useSegVideo2 = false;
 }
 
 void Resource::freeMemBlock() {
-	free(_memPtrStart);
-	_memPtrStart = 0;
+	stopPrefetch();
+	_resArena.release();
+	for (int i = 0; i < PARTS_COUNT; ++i) {
+		_partsMem[i].arena.release();
+		_partsMem[i].resident = false;
+	}
+	free(_bitmapBuf);
+	_bitmapBuf = 0;
+	_bitmapBufSize = 0;
 }
 
 void Resource::readDemo3Joy() {
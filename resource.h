@@ -7,6 +7,7 @@
 #ifndef RESOURCE_H__
 #define RESOURCE_H__
 
+#include <vector>
 #include "intern.h"
 
 struct MemEntry {
@@ -59,6 +60,39 @@ struct DemoJoy {
 	}
 };
 
+struct MemBlock {
+	uint8_t *ptr;
+	uint32_t size;
+};
+
+// bump allocator over a growable list of blocks, reset() keeps the blocks for reuse
+struct MemArena {
+	std::vector<MemBlock> _blocks;
+	int _current;
+	uint32_t _used; // in the current block
+	uint32_t _size, _highWater;
+
+	MemArena();
+	~MemArena();
+
+	uint8_t *reserve(uint32_t size);
+	void commit(uint32_t size);
+	uint8_t *alloc(uint32_t size);
+	void reset();
+	void release();
+	uint32_t capacity() const;
+};
+
+// segments of a game part, kept in memory after the part is left
+struct PartMem {
+	MemArena arena;
+	uint8_t *segments[4];
+	bool resident;
+	uint32_t lastUse;
+};
+
+struct File;
+struct PartPrefetch;
 struct ResourceNth;
 struct ResourceWin31;
 struct Resource3do;
@@ -91,6 +125,8 @@ struct Resource {
 
 	enum {
 		MEM_BLOCK_SIZE = 1 * 1024 * 1024,
+		MEM_RESIDENT_SIZE = 4 * 1024 * 1024, // game parts kept in memory
+		PARTS_COUNT = 10,
 		ENTRIES_COUNT = 146,
 		ENTRIES_COUNT_20TH = 178,
 	};
@@ -111,10 +147,17 @@ struct Resource {
 	MemEntry _memList[ENTRIES_COUNT_20TH];
 	uint16_t _numMemList;
 	uint16_t _currentPart, _nextPart;
-	uint8_t *_memPtrStart, *_scriptBakPtr, *_scriptCurPtr, *_vidCurPtr;
+	uint16_t _tracePart, _traceRequest; // part and update request the loads are recorded for
+	MemArena _resArena; // sounds, music and bitmaps loaded after the part segments
+	PartMem _partsMem[PARTS_COUNT];
+	MemArena *_curArena;
+	uint32_t _partsCounter;
+	uint8_t *_bitmapBuf;
+	uint32_t _bitmapBufSize;
 	bool _useSegVideo2;
 	uint8_t *_segVideoPal;
 	uint8_t *_segCode;
+	uint32_t _segCodeSize;
 	uint8_t *_segVideo1;
 	uint8_t *_segVideo2;
 	const char *_bankPrefix;
@@ -126,6 +169,9 @@ struct Resource {
 	Language _lang;
 	const AmigaMemEntry *_amigaMemList;
 	DemoJoy _demo3Joy;
+	File *_bankFiles[256];
+	PartPrefetch *_prefetch;
+	File *_packFile;
 
 	Resource(Video *vid, const char *dataDir);
 	~Resource();
@@ -133,10 +179,21 @@ struct Resource {
 	DataType getDataType() const { return _dataType; }
 	void detectVersion();
 	const char *getGameTitle(Language lang) const;
+	bool openBank(File &f, int bankNum);
+	File *getBankFile(int bankNum);
 	bool readBank(const MemEntry *me, uint8_t *dstBuf);
+	bool readBankEntry(File &f, const MemEntry *me, uint8_t *dstBuf);
+	void getPackEntries(bool *pending);
+	void getPackStamp(uint32_t *size, uint32_t *mtime);
+	bool openPack();
+	uint8_t *findPackEntry(int num, uint32_t *size);
+	bool writePack(const char *path);
+	uint8_t *mapEntry(File &f, const MemEntry *me);
+	void storeEntry(File &f, const MemEntry *me, const uint8_t *data);
 	void readEntries();
 	void readEntriesAmiga(const AmigaMemEntry *entries, int count);
 	void dumpEntries();
+	void loadResident();
 	void load();
 	void invalidateAll();
 	void invalidateRes();	
@@ -145,10 +202,18 @@ struct Resource {
 	uint8_t *loadDat(int num);
 	void loadFont();
 	void loadHeads();
-	uint8_t *loadWav(int num);
+	uint8_t *loadWav(int num, int **ref);
 	const char *getString(int num);
 	const char *getMusicPath(int num, char *buf, int bufSize, uint32_t *offset = 0);
 	void setupPart(int part);
+	bool restorePart(int part);
+	void beginPart(int part);
+	void endPart(int part);
+	void startPrefetch(int part);
+	void stopPrefetch();
+	uint8_t *commitPrefetch(int num);
+	uint32_t getDatSize(int num);
+	uint8_t *getBitmapBuffer(uint32_t size);
 	void allocMemBlock();
 	void freeMemBlock();
 	void readDemo3Joy();
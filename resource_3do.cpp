@@ -1,6 +1,7 @@
 
 #include <sys/stat.h>
 #include <unistd.h>
+#include "diskcache.h"
 #include "resource_3do.h"
 #include "util.h"
 
@@ -27,10 +28,11 @@ struct OperaIso {
 	File _f;
 	OperaIsoEntry *_entries;
 	int _entriesCount;
+	int _entriesSize;
 
 	OperaIso(const char *filePath)
-		: _entries(0), _entriesCount(0) {
-		_f.open(filePath);
+		: _entries(0), _entriesCount(0), _entriesSize(0) {
+		_f.openMmap(filePath);
 	}
 	~OperaIso() {
 		free(_entries);
@@ -46,36 +48,69 @@ struct OperaIso {
 			warning("Unexpected Opera ISO signature");
 			return;
 		}
+		// the game ships a few hundred files, avoid growing the table for each of them
+		_entriesSize = 512;
+		_entries = (OperaIsoEntry *)malloc(_entriesSize * sizeof(OperaIsoEntry));
+		if (!_entries) {
+			warning("Unable to allocate %d entries", _entriesSize);
+			_entriesSize = 0;
+			return;
+		}
 		const int block = READ_BE_UINT32(buf + 100);
 		readTocEntry(block);
 		qsort(_entries, _entriesCount, sizeof(OperaIsoEntry), compareOperaIsoEntry);
 	}
+	OperaIsoEntry *addEntry() {
+		if (_entriesCount == _entriesSize) {
+			const int size = _entriesSize * 2;
+			OperaIsoEntry *entries = (OperaIsoEntry *)realloc(_entries, size * sizeof(OperaIsoEntry));
+			if (!entries) {
+				warning("Unable to allocate %d entries", size);
+				return 0;
+			}
+			_entries = entries;
+			_entriesSize = size;
+		}
+		return &_entries[_entriesCount++];
+	}
 	void readTocEntry(int block) {
+		uint8_t buf[ISO_BLOCK_SIZE];
 		uint32_t attr = 0;
 		do {
-			_f.seek(block * ISO_BLOCK_SIZE + 20, SEEK_SET);
+			// parse the directory block from memory rather than seeking to each record
+			const uint8_t *p = _f.borrow(block * ISO_BLOCK_SIZE, ISO_BLOCK_SIZE);
+			if (!p) {
+				if (_f.readAt(block * ISO_BLOCK_SIZE, buf, ISO_BLOCK_SIZE) != ISO_BLOCK_SIZE) {
+					warning("Failed to read directory block %d", block);
+					return;
+				}
+				p = buf;
+			}
+			uint32_t pos = 20;
 			do {
-				uint8_t buf[72];
-				_f.read(buf, sizeof(buf));
-				attr = READ_BE_UINT32(buf);
-				const char *name = (const char *)buf + 32;
-				const uint32_t count = READ_BE_UINT32(buf + 64);
-				const uint32_t offset = READ_BE_UINT32(buf + 68);
-				_f.seek(count * 4, SEEK_CUR);
+				if (pos + 72 > ISO_BLOCK_SIZE) {
+					warning("Truncated directory block %d", block);
+					return;
+				}
+				const uint8_t *rec = p + pos;
+				attr = READ_BE_UINT32(rec);
+				const char *name = (const char *)rec + 32;
+				const uint32_t count = READ_BE_UINT32(rec + 64);
+				const uint32_t offset = READ_BE_UINT32(rec + 68);
+				pos += 72 + count * 4;
 				switch (attr & 255) {
-				case 2:
-					_entries = (OperaIsoEntry *)realloc(_entries, (_entriesCount + 1) * sizeof(OperaIsoEntry));
-					if (_entries) {
-						OperaIsoEntry *e = &_entries[_entriesCount];
-						strncpy(e->name, name, sizeof(e->name) - 1);
-						e->name[sizeof(e->name) - 1] = 0;
-						e->offset = offset * ISO_BLOCK_SIZE;
-						e->size = READ_BE_UINT32(buf + 16);
-						++_entriesCount;
+				case 2: {
+						OperaIsoEntry *e = addEntry();
+						if (e) {
+							memcpy(e->name, name, sizeof(e->name) - 1);
+							e->name[sizeof(e->name) - 1] = 0;
+							e->offset = offset * ISO_BLOCK_SIZE;
+							e->size = READ_BE_UINT32(rec + 16);
+						}
 					}
 					break;
 				case 7:
-					if (strcmp(name, "GameData") == 0) {
+					if (strncmp(name, "GameData", 32) == 0) {
 						readTocEntry(offset);
 					}
 					break;
@@ -89,20 +124,50 @@ struct OperaIso {
 	}
 };
 
-static int decodeLzss(const uint8_t *src, uint32_t len, uint8_t *dst) {
+static const uint8_t LZSS_TAG[4] = { 0x00, 0xF4, 0x01, 0x00 };
+static const uint32_t LZSS_DECODED_SIZE = 64000 * 2;
+
+static uint32_t decodeLzss(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dstSize) {
 	uint32_t rd = 0, wr = 0;
 	while (rd < len) {
-		const uint8_t code = src[rd++];
-		for (int j = 0; j < 8 && rd < len; ++j) {
-			if (code & (1 << j)) {
+		uint8_t code = src[rd++];
+		if (code == 0xFF && rd + 8 <= len && wr + 8 <= dstSize) {
+			// 8 literals
+			memcpy(dst + wr, src + rd, 8);
+			rd += 8;
+			wr += 8;
+			continue;
+		}
+		for (int j = 0; j < 8 && rd < len; ++j, code >>= 1) {
+			if (code & 1) {
+				if (wr >= dstSize) {
+					return wr;
+				}
 				dst[wr++] = src[rd++];
 			} else {
-				const uint16_t offset = 0xF000 | src[rd] | ((src[rd + 1] & 0xF) << 8);
-				const int len = (src[rd + 1] >> 4) + 3;
+				if (rd + 2 > len) {
+					return wr;
+				}
+				const uint32_t distance = 0x1000 - (src[rd] | ((src[rd + 1] & 0xF) << 8));
+				uint32_t count = (src[rd + 1] >> 4) + 3;
 				rd += 2;
-				for (int i = 0; i < len; ++i) {
-					dst[wr] = dst[wr + (int16_t)offset];
-					++wr;
+				if (wr + count > dstSize) {
+					return wr;
+				}
+				if (distance > wr) {
+					// reference before the start of the output
+					const uint32_t zero = (distance - wr < count) ? distance - wr : count;
+					memset(dst + wr, 0, zero);
+					wr += zero;
+					count -= zero;
+				}
+				if (distance >= count) {
+					memcpy(dst + wr, dst + wr - distance, count);
+					wr += count;
+				} else {
+					for (uint32_t i = 0; i < count; ++i, ++wr) {
+						dst[wr] = dst[wr - distance];
+					}
 				}
 			}
 		}
@@ -110,49 +175,61 @@ static int decodeLzss(const uint8_t *src, uint32_t len, uint8_t *dst) {
 	return wr;
 }
 
-static void decodeCcb16(int ccbWidth, int ccbHeight, File *f, uint32_t dataSize, uint16_t *dst) {
+static void decodeCcb16(int ccbWidth, int ccbHeight, const uint8_t *src, uint32_t dataSize, uint16_t *dst) {
+	const uint8_t *end = src + dataSize;
 	for (int y = 0; y < ccbHeight; ++y) {
-		const int scanlineSize = 4 * (f->readUint16BE() + 2);
-		int scanlineLen = 2;
+		if (end - src < 2) {
+			warning("Truncated CCB data at line %d", y);
+			memset(dst, 0, (ccbHeight - y) * ccbWidth * sizeof(uint16_t));
+			return;
+		}
+		const int scanlineSize = 4 * (READ_BE_UINT16(src) + 2);
+		// the scanline size includes the 2 bytes header, clip it to the span
+		const uint8_t *next = (scanlineSize < end - src) ? src + scanlineSize : end;
+		const uint8_t *p = src + 2;
+		uint16_t *line = dst;
 		int w = ccbWidth;
-		while (w > 0) {
-			uint8_t code = f->readByte();
-			++scanlineLen;
-			const int count = (code & 63) + 1;
+		while (w > 0 && p < next) {
+			uint8_t code = *p++;
+			int count = (code & 63) + 1;
 			code >>= 6;
 			if (code == 0) {
 				break;
 			}
+			if (count > w) {
+				count = w;
+			}
 			switch (code) {
 			case 1:
+				if (next - p < count * 2) {
+					count = (next - p) / 2;
+				}
 				for (int i = 0; i < count; ++i) {
-					*dst++ = f->readUint16BE();
+					*dst++ = READ_BE_UINT16(p);
+					p += 2;
 				}
-				scanlineLen += count * 2;
 				break;
 			case 2:
 				memset(dst, 0, count * sizeof(uint16_t));
 				dst += count;
 				break;
 			case 3: {
-					const uint16_t color = f->readUint16BE();
+					if (next - p < 2) {
+						count = 0;
+						break;
+					}
+					const uint16_t color = READ_BE_UINT16(p);
+					p += 2;
 					for (int i = 0; i < count; ++i) {
 						*dst++ = color;
 					}
-					scanlineLen += 2;
 				}
 				break;
 			}
 			w -= count;
 		}
-		assert(w >= 0);
-		if (w > 0) {
-			dst += w;
-		}
-		const int align = scanlineSize - scanlineLen;
-		if (align != 0) {
-			f->seek(align, SEEK_CUR);
-		}
+		dst = line + ccbWidth;
+		src = next;
 	}
 }
 
@@ -160,13 +237,17 @@ static const uint8_t _ccb_bppTable[8] = {
         0, 1, 2, 4, 6, 8, 16, 0
 };
 
-static uint16_t *decodeShapeCcb(File *f, int dataSize, int *w, int *h) {
-	const uint32_t flags = f->readUint32BE();
-	f->seek(4, SEEK_CUR);
-	const uint32_t celData = f->readUint32BE();
-	f->seek(40, SEEK_CUR);
-	const uint32_t pre0 = f->readUint32BE();
-	const uint32_t pre1 = f->readUint32BE();
+static const int CCB_HEADER_SIZE = 60;
+
+static uint16_t *decodeShapeCcb(const uint8_t *data, uint32_t dataSize, int *w, int *h) {
+	if (dataSize < (uint32_t)CCB_HEADER_SIZE) {
+		warning("Unexpected CCB size %d", dataSize);
+		return 0;
+	}
+	const uint32_t flags = READ_BE_UINT32(data);
+	const uint32_t celData = READ_BE_UINT32(data + 8);
+	const uint32_t pre0 = READ_BE_UINT32(data + 52);
+	const uint32_t pre1 = READ_BE_UINT32(data + 56);
 	assert(celData == 0x30);
 	assert(flags & (1 << 9));
 	const int bpp = _ccb_bppTable[pre0 & 7];
@@ -175,13 +256,31 @@ static uint16_t *decodeShapeCcb(File *f, int dataSize, int *w, int *h) {
 	const uint32_t height = ((pre0 >> 6) & 0x3FF) + 1;
 	uint16_t *buffer = (uint16_t *)malloc(width * height * sizeof(uint16_t));
 	if (buffer) {
-		decodeCcb16(width, height, f, dataSize - 60, buffer);
+		decodeCcb16(width, height, data + CCB_HEADER_SIZE, dataSize - CCB_HEADER_SIZE, buffer);
 		*w = width;
 		*h = height;
 	}
 	return buffer;
 }
 
+static uint16_t *decodeShapeCcb(File *f, uint32_t offset, uint32_t dataSize, int *w, int *h) {
+	const uint8_t *data = f->borrow(offset, dataSize);
+	if (data) {
+		return decodeShapeCcb(data, dataSize, w, h);
+	}
+	uint8_t *buf = (uint8_t *)malloc(dataSize);
+	if (!buf) {
+		warning("Unable to allocate %d bytes", dataSize);
+		return 0;
+	}
+	uint16_t *buffer = 0;
+	if (f->readAt(offset, buf, dataSize) == (int)dataSize) {
+		buffer = decodeShapeCcb(buf, dataSize, w, h);
+	}
+	free(buf);
+	return buffer;
+}
+
 Resource3do::Resource3do(const char *dataPath)
 	: _dataPath(dataPath) {
 	struct stat st;
@@ -204,64 +303,114 @@ bool Resource3do::readEntries() {
 	return true;
 }
 
-uint8_t *Resource3do::loadFile(int num, uint8_t *dst, uint32_t *size) {
-	uint8_t *in = dst;
+File *Resource3do::openFile(int num, File &f, uint32_t *offset, uint32_t *size) {
 	if (_iso) {
 		char name[16];
 		snprintf(name, sizeof(name), "File%d", num);
 		const OperaIsoEntry *e = _iso->find(name);
-		if (e) {
-			if (!dst) {
-				dst = (uint8_t *)malloc(e->size);
-				if (!dst) {
-					warning("Unable to allocate %d bytes", e->size);
-					return 0;
-				}
-			}
-			*size = e->size;
-			_iso->_f.seek(e->offset);
-			_iso->_f.read(dst, e->size);
-		} else {
+		if (!e) {
 			warning("Failed to load '%s'", name);
 			return 0;
 		}
-	} else {
-		char path[MAXPATHLEN];
-		snprintf(path, sizeof(path), "%s/GameData/File%d", _dataPath, num);
-		File f;
-		if (f.open(path)) {
-			const int sz = f.size();
-			if (!dst) {
-				dst = (uint8_t *)malloc(sz);
-				if (!dst) {
-					warning("Unable to allocate %d bytes", sz);
-					return 0;
-				}
+		*offset = e->offset;
+		*size = e->size;
+		return &_iso->_f;
+	}
+	char path[MAXPATHLEN];
+	snprintf(path, sizeof(path), "%s/GameData/File%d", _dataPath, num);
+	if (!f.openMmap(path)) {
+		warning("Failed to load '%s'", path);
+		return 0;
+	}
+	*offset = 0;
+	*size = f.size();
+	return &f;
+}
+
+static bool isLzss(File *f, uint32_t offset, uint32_t size) {
+	uint8_t buf[4];
+	return size >= 4 && f->readAt(offset, buf, 4) == 4 && memcmp(buf, LZSS_TAG, 4) == 0;
+}
+
+uint32_t Resource3do::getFileSize(int num) {
+	File f;
+	uint32_t offset, size;
+	File *src = openFile(num, f, &offset, &size);
+	if (!src) {
+		return 0;
+	}
+	return isLzss(src, offset, size) ? LZSS_DECODED_SIZE : size;
+}
+
+uint8_t *Resource3do::loadFile(int num, uint8_t *dst, uint32_t *size) {
+	File f;
+	uint32_t offset, dataSize;
+	File *src = openFile(num, f, &offset, &dataSize);
+	if (!src) {
+		return 0;
+	}
+	uint8_t *in = dst;
+	if (!isLzss(src, offset, dataSize)) {
+		*size = dataSize;
+		if (dst) {
+			// use the file data in place if it is memory mapped, the GameData files are closed on return
+			uint8_t *data = (src != &f) ? src->borrow(offset, dataSize) : 0;
+			if (data) {
+				return data;
 			}
-			*size = sz;
-			f.read(dst, sz);
 		} else {
-			warning("Failed to load '%s'", path);
+			dst = (uint8_t *)malloc(dataSize);
+			if (!dst) {
+				warning("Unable to allocate %d bytes", dataSize);
+				return 0;
+			}
+		}
+		src->readAt(offset, dst, dataSize);
+		return dst;
+	}
+	char name[16];
+	snprintf(name, sizeof(name), "lzss_%03d", num);
+	uint32_t cachedSize;
+	uint8_t *p = DiskCache::lookup(name, *src, &cachedSize);
+	if (p && cachedSize == LZSS_DECODED_SIZE && dst) {
+		// shared with the other processes using the same cache
+		*size = LZSS_DECODED_SIZE;
+		return p;
+	}
+	// the decoded data is written straight to the destination buffer, large enough for LZSS_DECODED_SIZE bytes
+	if (!dst) {
+		dst = (uint8_t *)malloc(LZSS_DECODED_SIZE);
+		if (!dst) {
+			warning("Unable to allocate %d bytes", LZSS_DECODED_SIZE);
 			return 0;
 		}
 	}
-	if (dst && memcmp(dst, "\x00\xf4\x01\x00", 4) == 0) {
-		static const int SZ = 64000 * 2;
-		uint8_t *tmp = (uint8_t *)calloc(1, SZ);
+	if (p && cachedSize == LZSS_DECODED_SIZE) {
+		memcpy(dst, p, LZSS_DECODED_SIZE);
+		*size = LZSS_DECODED_SIZE;
+		return dst;
+	}
+	uint8_t *tmp = 0;
+	const uint8_t *data = src->borrow(offset, dataSize);
+	if (!data) {
+		tmp = (uint8_t *)malloc(dataSize);
 		if (!tmp) {
-			warning("Unable to allocate %d bytes", SZ);
+			warning("Unable to allocate %d bytes", dataSize);
 			if (in != dst) free(dst);
 			return 0;
 		}
-		const int decodedSize = decodeLzss(dst + 4, *size - 4, tmp);
+		src->readAt(offset, tmp, dataSize);
+		data = tmp;
+	}
+	const uint32_t decodedSize = decodeLzss(data + 4, dataSize - 4, dst, LZSS_DECODED_SIZE);
+	free(tmp);
+	if (decodedSize != LZSS_DECODED_SIZE) {
+		warning("Unexpected LZSS decoded size %d", decodedSize);
 		if (in != dst) free(dst);
-		if (decodedSize != SZ) {
-			warning("Unexpected LZSS decoded size %d", decodedSize);
-			return 0;
-		}
-		*size = decodedSize;
-		return tmp;
+		return 0;
 	}
+	DiskCache::store(name, *src, dst, LZSS_DECODED_SIZE);
+	*size = LZSS_DECODED_SIZE;
 	return dst;
 }
 
@@ -269,16 +418,14 @@ uint16_t *Resource3do::loadShape555(const char *name, int *w, int *h) {
 	if (_iso) {
 		const OperaIsoEntry *e = _iso->find(name);
 		if (e) {
-			_iso->_f.seek(e->offset);
-			return decodeShapeCcb(&_iso->_f, e->size, w, h);
+			return decodeShapeCcb(&_iso->_f, e->offset, e->size, w, h);
 		}
 	} else {
 		char path[MAXPATHLEN];
 		snprintf(path, sizeof(path), "%s/GameData/%s", _dataPath, name);
 		File f;
-		if (f.open(path)) {
-			const uint32_t dataSize = f.size();
-			return decodeShapeCcb(&f, dataSize, w, h);
+		if (f.openMmap(path)) {
+			return decodeShapeCcb(&f, 0, f.size(), w, h);
 		}
 	}
 	return 0;
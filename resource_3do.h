@@ -19,6 +19,9 @@ struct Resource3do {
 
 	bool readEntries();
 
+	File *openFile(int num, File &f, uint32_t *offset, uint32_t *size);
+
+	uint32_t getFileSize(int num);
 	uint8_t *loadFile(int num, uint8_t *dst, uint32_t *size);
 	uint16_t *loadShape555(const char *name, int *w, int *h);
 	const char *getMusicName(int num, uint32_t *offset);
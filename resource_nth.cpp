@@ -2,6 +2,8 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <zlib.h>
+#include "bitmap.h"
+#include "diskcache.h"
 #include "pak.h"
 #include "resource_nth.h"
 #include "util.h"
@@ -49,6 +51,10 @@ struct Resource15th: ResourceNth {
 		return _pak._entriesCount != 0;
 	}
 
+	virtual File *getDataFile() {
+		return &_pak._f;
+	}
+
 	virtual uint8_t *load(const char *name) {
 		uint8_t *buf = 0;
 		const PakEntry *e = _pak.find(name);
@@ -79,6 +85,10 @@ struct Resource15th: ResourceNth {
 		snprintf(name, sizeof(name), "file%03d.dat", num);
 		const PakEntry *e = _pak.find(name);
 		if (e) {
+			uint8_t *p = _pak.borrowData(e, size);
+			if (p) {
+				return p;
+			}
 			_pak.loadData(e, dst, size);
 			return dst;
 		} else {
@@ -87,7 +97,14 @@ struct Resource15th: ResourceNth {
 		return 0;
 	}
 
-	virtual uint8_t *loadWav(int num, uint8_t *dst, uint32_t *size) {
+	virtual uint32_t getDatSize(int num) {
+		char name[32];
+		snprintf(name, sizeof(name), "file%03d.dat", num);
+		const PakEntry *e = _pak.find(name);
+		return e ? e->size : 0;
+	}
+
+	virtual uint8_t *loadWav(int num, int **ref) {
 		char name[32];
 		const PakEntry *e = 0;
 		if (Script::_useRemasteredAudio) {
@@ -103,13 +120,29 @@ struct Resource15th: ResourceNth {
 			}
 		}
 		if (e) {
-			uint8_t *p = (uint8_t *)malloc(e->size);
-			if (p) {
-				_pak.loadData(e, p, size);
-				*size = 0;
-				return p;
+			SoundCacheEntry *se = _sounds.find(e->name);
+			if (!se) {
+				uint32_t size;
+				uint8_t *p = _pak.borrowData(e, &size);
+				if (p) {
+					se = _sounds.add(e->name, p, size, true);
+					*ref = &se->ref;
+					return se->data;
+				}
+				p = (uint8_t *)malloc(e->size);
+				if (!p) {
+					warning("Failed to allocate %d bytes", e->size);
+					return 0;
+				}
+				_pak.loadData(e, p, &size);
+				if (size == 0) {
+					free(p);
+					return 0;
+				}
+				se = _sounds.add(e->name, p, size);
 			}
-			warning("Failed to allocate %d bytes", e->size);
+			*ref = &se->ref;
+			return se->data;
 		} else {
 			warning("Unable to load '%s'", name);
 		}
@@ -212,48 +245,103 @@ struct Resource15th: ResourceNth {
 	}
 };
 
-static uint8_t *inflateGzip(const char *filepath) {
-	File f;
-	if (!f.open(filepath)) {
-		warning("Unable to open '%s'", filepath);
-		return 0;
+struct GzipStream {
+	File _f;
+	z_stream _str;
+	Bytef _buf[1 << MAX_WBITS];
+	uint32_t _dataSize;
+	bool _eos;
+
+	GzipStream()
+		: _dataSize(0), _eos(false) {
+		memset(&_str, 0, sizeof(_str));
 	}
-	const uint16_t sig = f.readUint16LE();
-	if (sig != 0x8B1F) {
-		warning("Unexpected file signature 0x%x for '%s'", sig, filepath);
-		return 0;
+
+	~GzipStream() {
+		inflateEnd(&_str);
 	}
-	f.seek(-4, SEEK_END);
-	const uint32_t dataSize = f.readUint32LE();
-	uint8_t *out = (uint8_t *)malloc(dataSize);
-	if (!out) {
-		warning("Failed to allocate %d bytes", dataSize);
-		return 0;
+
+	bool open(const char *filepath) {
+		if (!_f.open(filepath)) {
+			warning("Unable to open '%s'", filepath);
+			return false;
+		}
+		const uint16_t sig = _f.readUint16LE();
+		if (sig != 0x8B1F) {
+			warning("Unexpected file signature 0x%x for '%s'", sig, filepath);
+			return false;
+		}
+		_f.seek(-4, SEEK_END);
+		_dataSize = _f.readUint32LE();
+		_f.seek(0);
+		if (inflateInit2(&_str, MAX_WBITS + 16) != Z_OK) {
+			return false;
+		}
+		_str.next_in = _buf;
+		_str.avail_in = 0;
+		return true;
 	}
-	f.seek(0);
-	z_stream str;
-	memset(&str, 0, sizeof(str));
-	int err = inflateInit2(&str, MAX_WBITS + 16);
-	if (err == Z_OK) {
-		Bytef buf[1 << MAX_WBITS];
-		str.next_in = buf;
-		str.avail_in = 0;
-		str.next_out = out;
-		str.avail_out = dataSize;
-		while (err == Z_OK && str.avail_out != 0) {
-			if (str.avail_in == 0 && !f.ioErr()) {
-				str.next_in = buf;
-				str.avail_in = f.read(buf, sizeof(buf));
+
+	bool read(uint8_t *dst, uint32_t len) {
+		_str.next_out = dst;
+		_str.avail_out = len;
+		while (_str.avail_out != 0) {
+			if (_eos) {
+				return false;
+			}
+			if (_str.avail_in == 0 && !_f.ioErr()) {
+				_str.next_in = _buf;
+				_str.avail_in = _f.read(_buf, sizeof(_buf));
+			}
+			const int err = inflate(&_str, Z_NO_FLUSH);
+			if (err == Z_STREAM_END) {
+				_eos = true;
+			} else if (err != Z_OK) {
+				return false;
 			}
-			err = inflate(&str, Z_NO_FLUSH);
 		}
-		inflateEnd(&str);
-		if (err == Z_STREAM_END) {
-			return out;
+		return true;
+	}
+
+	static bool readProc(void *userdata, uint8_t *dst, uint32_t len) {
+		return ((GzipStream *)userdata)->read(dst, len);
+	}
+};
+
+// when 'mapped' is set, the data can be returned as a mapping of the disk cache entry
+static uint8_t *inflateGzip(const char *filepath, uint32_t *dataSize = 0, bool *mapped = 0) {
+	GzipStream gz;
+	if (!gz.open(filepath)) {
+		return 0;
+	}
+	char name[16];
+	snprintf(name, sizeof(name), "gz_%08x", DiskCache::hash(filepath));
+	uint32_t size;
+	uint8_t *p = DiskCache::lookup(name, gz._f, &size);
+	if (dataSize) {
+		*dataSize = gz._dataSize;
+	}
+	if (mapped) {
+		*mapped = (p && size == gz._dataSize);
+		if (*mapped) {
+			return p;
 		}
 	}
-	free(out);
-	return 0;
+	uint8_t *out = (uint8_t *)malloc(gz._dataSize);
+	if (!out) {
+		warning("Failed to allocate %d bytes", gz._dataSize);
+		return 0;
+	}
+	if (p && size == gz._dataSize) {
+		memcpy(out, p, size);
+		return out;
+	}
+	if (!gz.read(out, gz._dataSize)) {
+		free(out);
+		return 0;
+	}
+	DiskCache::store(name, gz._f, out, gz._dataSize);
+	return out;
 }
 
 struct Resource20th: ResourceNth {
@@ -335,6 +423,21 @@ struct Resource20th: ResourceNth {
 		return inflateGzip(path);
 	}
 
+	virtual uint8_t *loadBmpRGB(int num, int *w, int *h) {
+		char path[MAXPATHLEN];
+		if (num >= 3000 && _bitmapSize) {
+			snprintf(path, sizeof(path), "%s/game/BGZ/data%s/%s_e%04d.bgz", _dataPath, _bitmapSize, _bitmapSize, num);
+		} else {
+			snprintf(path, sizeof(path), "%s/game/BGZ/file%03d.bgz", _dataPath, num);
+		}
+		// convert the rows as they are inflated, the .bmp is never fully in memory
+		GzipStream gz;
+		if (!gz.open(path)) {
+			return 0;
+		}
+		return decode_bitmap_stream(GzipStream::readProc, &gz, w, h);
+	}
+
 	void preloadDat(int part, int type, int num) {
 		static const char *names[] = {
 			"INTRO", "EAU", "PRI", "CITE", "arene", "LUXE", "FINAL", 0
@@ -382,7 +485,42 @@ struct Resource20th: ResourceNth {
 		return dst;
 	}
 
-	virtual uint8_t *loadWav(int num, uint8_t *dst, uint32_t *size) {
+	virtual bool openDat(int num, File &f) {
+		char path[MAXPATHLEN];
+		snprintf(path, sizeof(path), "%s/game/DAT", _dataPath);
+		char name[32];
+		snprintf(name, sizeof(name), "FILE%03d.DAT", num);
+		return f.open(name, path);
+	}
+
+	virtual uint32_t getDatSize(int num) {
+		File f;
+		if (_datName[0]) {
+			char path[MAXPATHLEN];
+			snprintf(path, sizeof(path), "%s/game/DAT", _dataPath);
+			if (f.open(_datName, path)) {
+				return f.size();
+			}
+		}
+		return openDat(num, f) ? f.size() : 0;
+	}
+
+	uint8_t *loadWavFile(const char *path, int **ref) {
+		SoundCacheEntry *se = _sounds.find(path);
+		if (!se) {
+			uint32_t size;
+			bool mapped;
+			uint8_t *p = inflateGzip(path, &size, &mapped);
+			if (!p) {
+				return 0;
+			}
+			se = _sounds.add(path, p, size, mapped);
+		}
+		*ref = &se->ref;
+		return se->data;
+	}
+
+	virtual uint8_t *loadWav(int num, int **ref) {
 		char path[MAXPATHLEN];
 		if (!Script::_useRemasteredAudio) {
 			snprintf(path, sizeof(path), "%s/game/WGZ/original/file%03d.wgz", _dataPath, num);
@@ -390,8 +528,7 @@ struct Resource20th: ResourceNth {
 			if (stat(path, &s) != 0) {
 				snprintf(path, sizeof(path), "%s/game/WGZ/original/file%03dB.wgz", _dataPath, num);
 			}
-			*size = 0;
-			return inflateGzip(path);
+			return loadWavFile(path, ref);
 		}
 		switch (num) {
 		case 81: {
@@ -438,8 +575,7 @@ struct Resource20th: ResourceNth {
 			}
 			break;
 		}
-		*size = 0;
-		return inflateGzip(path);
+		return loadWavFile(path, ref);
 	}
 
 	void loadStrings(Language lang) {
@@ -547,6 +683,16 @@ struct Resource20th: ResourceNth {
 	}
 };
 
+uint8_t *ResourceNth::loadBmpRGB(int num, int *w, int *h) {
+	uint8_t *buf = 0;
+	uint8_t *p = loadBmp(num);
+	if (p) {
+		buf = decode_bitmap(p, false, -1, w, h);
+		free(p);
+	}
+	return buf;
+}
+
 ResourceNth *ResourceNth::create(int edition, const char *dataPath) {
 	switch (edition) {
 	case 15:
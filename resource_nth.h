@@ -3,17 +3,28 @@
 #define RESOURCE_NTH_H__
 
 #include "intern.h"
+#include "soundcache.h"
+
+struct File;
 
 struct ResourceNth {
+	SoundCache _sounds;
+
 	virtual ~ResourceNth() {
 	}
 
 	virtual bool init() = 0;
 	virtual uint8_t *load(const char *name) = 0;
 	virtual uint8_t *loadBmp(int num) = 0;
+	virtual uint8_t *loadBmpRGB(int num, int *w, int *h);
 	virtual void preloadDat(int part, int type, int num) {}
 	virtual uint8_t *loadDat(int num, uint8_t *dst, uint32_t *size) = 0;
-	virtual uint8_t *loadWav(int num, uint8_t *dst, uint32_t *size) = 0;
+	virtual bool openDat(int num, File &f) { return false; }
+	// file holding all the entries, 0 when these are separate files
+	virtual File *getDataFile() { return 0; }
+	virtual uint32_t getDatSize(int num) = 0;
+	// the sound data is owned by the cache, *ref counts the mixer channels playing it
+	virtual uint8_t *loadWav(int num, int **ref) = 0;
 	virtual const char *getString(Language lang, int num) = 0;
 	virtual const char *getMusicName(int num) = 0;
 	virtual void getBitmapSize(int *w, int *h) = 0;
@@ -1,5 +1,6 @@
 
 #include <string.h>
+#include "diskcache.h"
 #include "resource_win31.h"
 #include "util.h"
 
@@ -34,17 +35,17 @@ static uint16_t decode(uint8_t *p, int size, uint16_t key) {
 }
 
 struct Bitstream {
-	File *_f;
+	const uint8_t *_p;
 	int _size;
 	uint16_t _bits;
 	int _len;
 
 	Bitstream()
-		: _f(0), _size(0), _bits(0), _len(0) {
+		: _p(0), _size(0), _bits(0), _len(0) {
 	}
 
-	void reset(File *f, int size) {
-		_f = f;
+	void reset(const uint8_t *p, int size) {
+		_p = p;
 		_size = size;
 		_bits = 0;
 		_len = 0;
@@ -55,7 +56,7 @@ struct Bitstream {
 			_bits <<= 8;
 			assert(_size > 0);
 			--_size;
-			_bits |= _f->readByte();
+			_bits |= *_p++;
 			_len += 8;
 		}
 		_len -= 8;
@@ -65,7 +66,7 @@ struct Bitstream {
 		if (_len == 0) {
 			assert(_size > 0);
 			--_size;
-			_bits = _f->readByte();
+			_bits = *_p++;
 			_len = 8;
 		}
 		--_len;
@@ -216,9 +217,26 @@ struct LzHuffman {
 	}
 
 	bool decompressEntry(File &f, const Win31BankEntry *e, uint8_t *out) {
-		f.seek(e->offset);
-		_stream.reset(&f, e->packedSize);
-		return decode(out, e->size);
+		// the packed data is read from the mapped file or with a single read
+		uint8_t *tmp = 0;
+		const uint8_t *p = f.borrow(e->offset, e->packedSize);
+		if (!p) {
+			tmp = (uint8_t *)malloc(e->packedSize);
+			if (!tmp) {
+				warning("Unable to allocate %d bytes", e->packedSize);
+				return false;
+			}
+			if (f.readAt(e->offset, tmp, e->packedSize) != (int)e->packedSize) {
+				warning("Failed to read %d bytes at 0x%x", e->packedSize, e->offset);
+				free(tmp);
+				return false;
+			}
+			p = tmp;
+		}
+		_stream.reset(p, e->packedSize);
+		const bool ret = decode(out, e->size);
+		free(tmp);
+		return ret;
 	}
 };
 
@@ -227,9 +245,10 @@ const char *ResourceWin31::FILENAME = "BANK";
 const char *ResourceWin31::EXECUTABLE = "WORLD.EXE";
 
 ResourceWin31::ResourceWin31(const char *dataPath)
-	:  _dataPath(dataPath), _entries(0), _entriesCount(0) {
-	_f.open(FILENAME, dataPath);
+	:  _dataPath(dataPath), _entries(0), _entriesCount(0), _cacheSize(0), _cacheMaxSize(CACHE_MAX_SIZE), _cacheCounter(0) {
+	_f.openMmap(FILENAME, dataPath);
 	memset(_bitmaps, 0, sizeof(_bitmaps));
+	memset(_dibs, 0, sizeof(_dibs));
 	if (_exe.open(EXECUTABLE, dataPath)) {
 		readExecutableResources();
 	}
@@ -238,8 +257,14 @@ ResourceWin31::ResourceWin31(const char *dataPath)
 }
 
 ResourceWin31::~ResourceWin31() {
+	for (int i = 0; i < _entriesCount; ++i) {
+		free(_entries[i].cachedData);
+	}
 	free(_entries);
 	free(_textBuf);
+	for (int i = 0; i < RESOURCE_BITMAP_COUNT; ++i) {
+		free(_dibs[i]);
+	}
 }
 
 bool ResourceWin31::readEntries() {
@@ -249,31 +274,51 @@ bool ResourceWin31::readEntries() {
 		_entriesCount = READ_LE_UINT16(buf + 4);
 		debug(DBG_RESOURCE, "Read %d entries in win31 '%s'", _entriesCount, FILENAME);
 		_entries = (Win31BankEntry *)calloc(_entriesCount, sizeof(Win31BankEntry));
-		if (_entries) {
-			uint16_t key = READ_LE_UINT16(buf + 0x14);
+		// read and descramble the whole table at once, the key runs across the entries
+		const int tocSize = _entriesCount * 32;
+		uint8_t *toc = (uint8_t *)malloc(tocSize);
+		if (_entries && toc && _f.read(toc, tocSize) == tocSize) {
+			decode(toc, tocSize, READ_LE_UINT16(buf + 0x14));
 			for (int i = 0; i < _entriesCount; ++i) {
-				_f.read(buf, sizeof(buf));
-				key = decode(buf, sizeof(buf), key);
+				const uint8_t *p = toc + i * 32;
 				Win31BankEntry *e = &_entries[i];
-				memcpy(e->name, buf, 16);
-				const uint16_t flags = READ_LE_UINT16(buf + 16);
-				e->type = buf[19];
-				e->size = READ_LE_UINT32(buf + 20);
-				e->offset = READ_LE_UINT32(buf + 24);
-				e->packedSize = READ_LE_UINT32(buf + 28);
+				memcpy(e->name, p, 16);
+				const uint16_t flags = READ_LE_UINT16(p + 16);
+				e->type = p[19];
+				e->size = READ_LE_UINT32(p + 20);
+				e->offset = READ_LE_UINT32(p + 24);
+				e->packedSize = READ_LE_UINT32(p + 28);
 				debug(DBG_RESOURCE, "Res #%03d '%s' type %d size %d (%d) offset 0x%x", i, e->name, e->type, e->size, e->packedSize, e->offset);
 				assert(e->size == 0 || flags == 0x80);
 			}
 			readStrings();
+		} else {
+			warning("Failed to read %d entries", _entriesCount);
+			free(_entries);
+			_entries = 0;
+			_entriesCount = 0;
 		}
+		free(toc);
 	}
 	return _entries != 0;
 }
 
+uint32_t ResourceWin31::getFileSize(int num) const {
+	return (num > 0 && num < _entriesCount) ? _entries[num].size : 0;
+}
+
 uint8_t *ResourceWin31::loadFile(int num, uint8_t *dst, uint32_t *size) {
 	if (num > 0 && num < _entriesCount) {
 		Win31BankEntry *e = &_entries[num];
 		*size = e->size;
+		char name[32];
+		snprintf(name, sizeof(name), "w31_%03d", num);
+		uint32_t cachedSize;
+		uint8_t *p = DiskCache::lookup(name, _f, &cachedSize);
+		if (p && cachedSize == e->size && dst) {
+			// shared with the other processes using the same cache
+			return p;
+		}
 		if (!dst) {
 			dst = (uint8_t *)malloc(e->size);
 			if (!dst) {
@@ -281,16 +326,28 @@ uint8_t *ResourceWin31::loadFile(int num, uint8_t *dst, uint32_t *size) {
 				return 0;
 			}
 		}
+		if (p && cachedSize == e->size) {
+			memcpy(dst, p, e->size);
+			return dst;
+		}
+		if (e->cachedData) {
+			e->lastUse = ++_cacheCounter;
+			memcpy(dst, e->cachedData, e->size);
+			return dst;
+		}
 		// check for unpacked data
-		char name[32];
 		snprintf(name, sizeof(name), "%03d_%s", num, e->name);
 		File f;
 		if (f.open(name, _dataPath) && f.size() == e->size) {
 			f.read(dst, e->size);
+			addToCache(num, dst);
 			return dst;
 		}
 		LzHuffman lzHuf;
 		if (lzHuf.decompressEntry(_f, e, dst)) {
+			snprintf(name, sizeof(name), "w31_%03d", num);
+			DiskCache::store(name, _f, dst, e->size);
+			addToCache(num, dst);
 			return dst;
 		}
 	}
@@ -298,6 +355,34 @@ uint8_t *ResourceWin31::loadFile(int num, uint8_t *dst, uint32_t *size) {
 	return 0;
 }
 
+void ResourceWin31::addToCache(int num, const uint8_t *data) {
+	Win31BankEntry *e = &_entries[num];
+	if (e->size == 0 || e->size > _cacheMaxSize) {
+		return;
+	}
+	// evict the least recently used entries
+	while (_cacheSize + e->size > _cacheMaxSize) {
+		Win31BankEntry *lru = 0;
+		for (int i = 0; i < _entriesCount; ++i) {
+			if (_entries[i].cachedData && (!lru || _entries[i].lastUse < lru->lastUse)) {
+				lru = &_entries[i];
+			}
+		}
+		if (!lru) {
+			break;
+		}
+		free(lru->cachedData);
+		lru->cachedData = 0;
+		_cacheSize -= lru->size;
+	}
+	e->cachedData = (uint8_t *)malloc(e->size);
+	if (e->cachedData) {
+		memcpy(e->cachedData, data, e->size);
+		e->lastUse = ++_cacheCounter;
+		_cacheSize += e->size;
+	}
+}
+
 static bool freadTag(File *f, const char *tag) {
 	for (; *tag; ++tag) {
 		if (f->readByte() != (uint8_t)*tag) {
@@ -375,22 +460,21 @@ const char *ResourceWin31::getMusicName(int num) const {
 	return 0;
 }
 
-uint8_t *ResourceWin31::getDib(int num) {
-	uint8_t *buf = 0;
-	if (num >= 0 && num < RESOURCE_BITMAP_COUNT) {
+const uint8_t *ResourceWin31::getDib(int num) {
+	if (num >= 0 && num < RESOURCE_BITMAP_COUNT && !_dibs[num]) {
 		const Win31ResourceBitmap *b = &_bitmaps[num];
 		if (b->size != 0) {
-			buf = (uint8_t *)malloc(b->size);
+			uint8_t *buf = (uint8_t *)malloc(b->size);
 			if (buf) {
-				_exe.seek(b->offset);
-				const uint32_t count = _exe.read(buf, b->size);
+				const uint32_t count = _exe.readAt(b->offset, buf, b->size);
 				if (count != b->size) {
 					warning("Failed to read %d bytes, count %d", b->size, count);
 					free(buf);
 					buf = 0;
 				}
 			}
+			_dibs[num] = buf;
 		}
 	}
-	return buf;
+	return (num >= 0 && num < RESOURCE_BITMAP_COUNT) ? _dibs[num] : 0;
 }
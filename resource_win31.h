@@ -11,6 +11,8 @@ struct Win31BankEntry {
 	uint32_t offset;
 	uint32_t size;
 	uint32_t packedSize;
+	uint8_t *cachedData;
+	uint32_t lastUse;
 };
 
 struct Win31ResourceBitmap {
@@ -22,7 +24,8 @@ struct Win31ResourceBitmap {
 struct ResourceWin31 {
 
 	enum {
-		RESOURCE_BITMAP_COUNT = 3
+		RESOURCE_BITMAP_COUNT = 3,
+		CACHE_MAX_SIZE = 8 * 1024 * 1024
 	};
 
 	static const char *FILENAME;
@@ -36,17 +39,22 @@ struct ResourceWin31 {
 	const char *_stringsTable[614];
 	File _exe;
 	Win31ResourceBitmap _bitmaps[RESOURCE_BITMAP_COUNT];
+	uint8_t *_dibs[RESOURCE_BITMAP_COUNT];
+	uint32_t _cacheSize, _cacheMaxSize;
+	uint32_t _cacheCounter;
 
 	ResourceWin31(const char *dataPath);
 	~ResourceWin31();
 
 	bool readEntries();
+	uint32_t getFileSize(int num) const;
 	uint8_t *loadFile(int num, uint8_t *dst, uint32_t *size);
+	void addToCache(int num, const uint8_t *data);
 	void readExecutableResources();
 	void readStrings();
 	const char *getString(int num) const;
 	const char *getMusicName(int num) const;
-	uint8_t *getDib(int num);
+	const uint8_t *getDib(int num);
 };
 
 #endif
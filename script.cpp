@@ -7,6 +7,7 @@
 #include <ctime>
 #include "graphics.h"
 #include "script.h"
+#include "scriptprofile.h"
 #include "mixer.h"
 #include "resource.h"
 #include "video.h"
@@ -402,6 +403,8 @@ void Script::restartAt(int part, int pos) {
 		_scriptVars[0x54] = awTitleScreen ? 0x1 : 0x81;
 	}
 	_res->setupPart(part);
+	const int dataType = _res->getDataType();
+	_code.reset(_res->_segCode, _res->_segCodeSize, _res->_currentPart, _is3DO, dataType == Resource::DT_DOS || dataType == Resource::DT_AMIGA || dataType == Resource::DT_ATARI);
 	memset(_scriptTasks, 0xFF, sizeof(_scriptTasks));
 	memset(_scriptStates, 0, sizeof(_scriptStates));
 	_scriptTasks[0][0] = 0;
@@ -441,7 +444,11 @@ void Script::runTasks() {
 				_stackPtr = 0;
 				_scriptPaused = false;
 				debug(DBG_SCRIPT, "Script::runTasks() i=0x%02X n=0x%02X", i, n);
-				executeTask();
+				if (ScriptProfile::_fp) {
+					executeTaskProfile(i);
+				} else {
+					executeTask();
+				}
 				_scriptTasks[0][i] = _scriptPtr.pc - _res->_segCode;
 				debug(DBG_SCRIPT, "Script::runTasks() i=0x%02X pos=0x%X", i, _scriptTasks[0][i]);
 			}
@@ -449,139 +456,396 @@ void Script::runTasks() {
 	}
 }
 
+static bool compareVar(int op, int16_t a, int16_t b) {
+	switch (op) {
+	case kInsnJmpIfEq:
+		return a == b;
+	case kInsnJmpIfNe:
+		return a != b;
+	case kInsnJmpIfGt:
+		return a > b;
+	case kInsnJmpIfGe:
+		return a >= b;
+	case kInsnJmpIfLt:
+		return a < b;
+	case kInsnJmpIfLe:
+		return a <= b;
+	}
+	return false;
+}
+
+// direct threaded dispatch with the labels as values extension
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
 void Script::executeTask() {
-	while (!_scriptPaused) {
-		uint8_t opcode = _scriptPtr.fetchByte();
-		if (opcode & 0x80) {
-			const uint16_t off = ((opcode << 8) | _scriptPtr.fetchByte()) << 1;
+	if (g_debugMask & DBG_SCRIPT) {
+		// the opcode handlers trace the execution
+		while (!_scriptPaused) {
+			executeInstruction();
+		}
+		return;
+	}
+	const uint8_t *seg = _res->_segCode;
+	int index = _code.getInsn(_scriptPtr.pc - seg);
+	if (index < 0) {
+		while (!_scriptPaused) {
+			executeInstruction();
+		}
+		return;
+	}
+	const ScriptInsn *code = _code.insns();
+	const ScriptInsn *insn = &code[index];
+	int16_t *vars = _scriptVars;
+
+#if defined(__GNUC__)
+	static const void *const labels[kInsnOpsCount] = {
+		&&insn_movConst, &&insn_mov, &&insn_add, &&insn_addConst, &&insn_call, &&insn_ret, &&insn_yieldTask, &&insn_jmp,
+		&&insn_installTask, &&insn_jmpIfVar, &&insn_jmpIfEq, &&insn_jmpIfNe, &&insn_jmpIfGt, &&insn_jmpIfGe, &&insn_jmpIfLt, &&insn_jmpIfLe,
+		&&insn_removeTask, &&insn_sub, &&insn_and, &&insn_or, &&insn_shl, &&insn_shr, &&insn_drawShape, &&insn_drawShapeZoom,
+		&&insn_condJmpJmp, &&insn_movConst2, &&insn_movConst3, &&insn_addConstJmpIfVar, &&insn_generic
+	};
+#define DISPATCH() goto *labels[insn->op]
+#define OP(name, op) name:
+#else
+#define DISPATCH() goto dispatch
+#define OP(name, op) case op:
+#endif
+#define NEXT() insn = code + insn->next; DISPATCH()
+#define JUMP(i) insn = code + (i); DISPATCH()
+#define RHS(insn) (((insn)->flags & kInsnVarRhs) ? vars[(insn)->x] : (insn)->x)
+
+	DISPATCH();
+#if !defined(__GNUC__)
+dispatch:
+	switch (insn->op) {
+#endif
+	OP(insn_movConst, kInsnMovConst)
+		vars[insn->a] = insn->n;
+		NEXT();
+	OP(insn_mov, kInsnMov)
+		vars[insn->a] = vars[insn->n];
+		NEXT();
+	OP(insn_add, kInsnAdd)
+		vars[insn->a] += vars[insn->n];
+		NEXT();
+	OP(insn_addConst, kInsnAddConst)
+		vars[insn->a] += (int16_t)insn->n;
+		NEXT();
+	OP(insn_call, kInsnCall)
+		if (_stackPtr == 0x40) {
+			error("Script::op_call() ec=0x%X stack overflow", 0x8F);
+		}
+		_scriptStackCalls[_stackPtr] = insn->offset + insn->size;
+		++_stackPtr;
+		JUMP(insn->target);
+	OP(insn_ret, kInsnRet)
+		if (_stackPtr == 0) {
+			error("Script::op_ret() ec=0x%X stack underflow", 0x8F);
+		}
+		--_stackPtr;
+		index = _code.getInsn(_scriptStackCalls[_stackPtr]);
+		if (index < 0) {
+			_scriptPtr.pc = (uint8_t *)seg + _scriptStackCalls[_stackPtr];
+			goto fallback;
+		}
+		code = _code.insns();
+		JUMP(index);
+	OP(insn_yieldTask, kInsnYieldTask)
+		_scriptPtr.pc = (uint8_t *)seg + insn->offset + insn->size;
+		_scriptPaused = true;
+		return;
+	OP(insn_jmp, kInsnJmp)
+		JUMP(insn->target);
+	OP(insn_installTask, kInsnInstallTask)
+		assert(insn->a < 0x40);
+		_scriptTasks[1][insn->a] = insn->n;
+		NEXT();
+	OP(insn_jmpIfVar, kInsnJmpIfVar)
+		--vars[insn->a];
+		if (vars[insn->a] != 0) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_jmpIfEq, kInsnJmpIfEq)
+		if (vars[insn->a] == RHS(insn)) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_jmpIfNe, kInsnJmpIfNe)
+		if (vars[insn->a] != RHS(insn)) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_jmpIfGt, kInsnJmpIfGt)
+		if (vars[insn->a] > RHS(insn)) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_jmpIfGe, kInsnJmpIfGe)
+		if (vars[insn->a] >= RHS(insn)) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_jmpIfLt, kInsnJmpIfLt)
+		if (vars[insn->a] < RHS(insn)) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_jmpIfLe, kInsnJmpIfLe)
+		if (vars[insn->a] <= RHS(insn)) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_removeTask, kInsnRemoveTask)
+		_scriptPtr.pc = (uint8_t *)seg + 0xFFFF;
+		_scriptPaused = true;
+		return;
+	OP(insn_sub, kInsnSub)
+		vars[insn->a] -= vars[insn->n];
+		NEXT();
+	OP(insn_and, kInsnAnd)
+		vars[insn->a] = (uint16_t)vars[insn->a] & insn->n;
+		NEXT();
+	OP(insn_or, kInsnOr)
+		vars[insn->a] = (uint16_t)vars[insn->a] | insn->n;
+		NEXT();
+	OP(insn_shl, kInsnShl)
+		vars[insn->a] = (uint16_t)vars[insn->a] << insn->n;
+		NEXT();
+	OP(insn_shr, kInsnShr)
+		vars[insn->a] = (uint16_t)vars[insn->a] >> insn->n;
+		NEXT();
+	OP(insn_drawShape, kInsnDrawShape) {
 			_res->_useSegVideo2 = false;
-			Point pt;
-			pt.x = _scriptPtr.fetchByte();
-			pt.y = _scriptPtr.fetchByte();
-			int16_t h = pt.y - 199;
-			if (h > 0) {
-				pt.y = 199;
-				pt.x += h;
-			}
-			debug(DBG_VIDEO, "vid_opcd_0x80 : opcode=0x%X off=0x%X x=%d y=%d", opcode, off, pt.x, pt.y);
-			_vid->setDataBuffer(_res->_segVideo1, off);
+			Point pt(insn->x, insn->y);
+			_vid->setDataBuffer(_res->_segVideo1, insn->n);
 			if (_is3DO) {
 				_vid->drawShape3DO(0xFF, 64, &pt);
 			} else {
 				_vid->drawShape(0xFF, 64, &pt);
 			}
-		} else if (opcode & 0x40) {
+		}
+		NEXT();
+	OP(insn_drawShapeZoom, kInsnDrawShapeZoom) {
 			Point pt;
-			const uint8_t offsetHi = _scriptPtr.fetchByte();
-			const uint16_t off = ((offsetHi << 8) | _scriptPtr.fetchByte()) << 1;
-			pt.x = _scriptPtr.fetchByte();
-			_res->_useSegVideo2 = false;
-			if (!(opcode & 0x20)) {
-				if (!(opcode & 0x10)) {
-					pt.x = (pt.x << 8) | _scriptPtr.fetchByte();
-				} else {
-					pt.x = _scriptVars[pt.x];
-				}
+			pt.x = (insn->flags & kInsnVarX) ? vars[insn->x] : insn->x;
+			pt.y = (insn->flags & kInsnVarY) ? vars[insn->y] : insn->y;
+			const uint16_t zoom = (insn->flags & kInsnVarZoom) ? vars[insn->zoom] : insn->zoom;
+			_res->_useSegVideo2 = (insn->flags & kInsnSegVideo2) != 0;
+			_vid->setDataBuffer(_res->_useSegVideo2 ? _res->_segVideo2 : _res->_segVideo1, insn->n);
+			if (_is3DO) {
+				_vid->drawShape3DO(0xFF, zoom, &pt);
 			} else {
-				if (opcode & 0x10) {
-					pt.x += 0x100;
-				}
+				_vid->drawShape(0xFF, zoom, &pt);
 			}
-			pt.y = _scriptPtr.fetchByte();
-			if (!(opcode & 8)) {
-				if (!(opcode & 4)) {
-					pt.y = (pt.y << 8) | _scriptPtr.fetchByte();
-				} else {
-					pt.y = _scriptVars[pt.y];
-				}
+		}
+		NEXT();
+	OP(insn_condJmpJmp, kInsnCondJmpJmp)
+		if (compareVar(insn->baseOp, vars[insn->a], RHS(insn))) {
+			JUMP(insn->target);
+		}
+		JUMP(code[insn->next].target);
+	OP(insn_movConst2, kInsnMovConst2)
+		vars[insn->a] = insn->n;
+		insn = code + insn->next;
+		vars[insn->a] = insn->n;
+		NEXT();
+	OP(insn_movConst3, kInsnMovConst3)
+		vars[insn->a] = insn->n;
+		insn = code + insn->next;
+		vars[insn->a] = insn->n;
+		insn = code + insn->next;
+		vars[insn->a] = insn->n;
+		NEXT();
+	OP(insn_addConstJmpIfVar, kInsnAddConstJmpIfVar)
+		vars[insn->a] += (int16_t)insn->n;
+		insn = code + insn->next;
+		--vars[insn->a];
+		if (vars[insn->a] != 0) {
+			JUMP(insn->target);
+		}
+		NEXT();
+	OP(insn_generic, kInsnGeneric) {
+			_scriptPtr.pc = (uint8_t *)seg + insn->offset;
+			executeInstruction();
+			if (_scriptPaused) {
+				return;
 			}
-			uint16_t zoom = 64;
-			if (!(opcode & 2)) {
-				if (opcode & 1) {
-					zoom = _scriptVars[_scriptPtr.fetchByte()];
-				}
+			const uint16_t pos = _scriptPtr.pc - seg;
+			if (pos == insn->offset + insn->size && insn->next != ScriptCode::kNone) {
+				NEXT();
+			}
+			// the 3DO specific opcodes can jump
+			index = _code.getInsn(pos);
+			if (index < 0) {
+				goto fallback;
+			}
+			code = _code.insns();
+			JUMP(index);
+		}
+#if !defined(__GNUC__)
+	}
+#endif
+#undef DISPATCH
+#undef OP
+#undef NEXT
+#undef JUMP
+#undef RHS
+
+fallback:
+	while (!_scriptPaused) {
+		executeInstruction();
+	}
+}
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+void Script::executeTaskProfile(int task) {
+	// one instruction at a time, the updateDisplay time includes the wait for the next frame
+	while (!_scriptPaused) {
+		const uint8_t *seg = _res->_segCode;
+		const int part = _res->_currentPart;
+		const uint16_t addr = _scriptPtr.pc - seg;
+		const uint64_t start = ScriptProfile::now();
+		executeInstruction();
+		ScriptProfile::record(part, task, seg, addr, start);
+	}
+}
+
+void Script::executeInstruction() {
+	uint8_t opcode = _scriptPtr.fetchByte();
+	if (opcode & 0x80) {
+		const uint16_t off = ((opcode << 8) | _scriptPtr.fetchByte()) << 1;
+		_res->_useSegVideo2 = false;
+		Point pt;
+		pt.x = _scriptPtr.fetchByte();
+		pt.y = _scriptPtr.fetchByte();
+		int16_t h = pt.y - 199;
+		if (h > 0) {
+			pt.y = 199;
+			pt.x += h;
+		}
+		debug(DBG_VIDEO, "vid_opcd_0x80 : opcode=0x%X off=0x%X x=%d y=%d", opcode, off, pt.x, pt.y);
+		_vid->setDataBuffer(_res->_segVideo1, off);
+		if (_is3DO) {
+			_vid->drawShape3DO(0xFF, 64, &pt);
+		} else {
+			_vid->drawShape(0xFF, 64, &pt);
+		}
+	} else if (opcode & 0x40) {
+		Point pt;
+		const uint8_t offsetHi = _scriptPtr.fetchByte();
+		const uint16_t off = ((offsetHi << 8) | _scriptPtr.fetchByte()) << 1;
+		pt.x = _scriptPtr.fetchByte();
+		_res->_useSegVideo2 = false;
+		if (!(opcode & 0x20)) {
+			if (!(opcode & 0x10)) {
+				pt.x = (pt.x << 8) | _scriptPtr.fetchByte();
 			} else {
-				if (opcode & 1) {
-					_res->_useSegVideo2 = true;
-				} else {
-					zoom = _scriptPtr.fetchByte();
-				}
+				pt.x = _scriptVars[pt.x];
 			}
-			debug(DBG_VIDEO, "vid_opcd_0x40 : off=0x%X x=%d y=%d", off, pt.x, pt.y);
-			_vid->setDataBuffer(_res->_useSegVideo2 ? _res->_segVideo2 : _res->_segVideo1, off);
-			if (_is3DO) {
-				_vid->drawShape3DO(0xFF, zoom, &pt);
+		} else {
+			if (opcode & 0x10) {
+				pt.x += 0x100;
+			}
+		}
+		pt.y = _scriptPtr.fetchByte();
+		if (!(opcode & 8)) {
+			if (!(opcode & 4)) {
+				pt.y = (pt.y << 8) | _scriptPtr.fetchByte();
 			} else {
-				_vid->drawShape(0xFF, zoom, &pt);
+				pt.y = _scriptVars[pt.y];
+			}
+		}
+		uint16_t zoom = 64;
+		if (!(opcode & 2)) {
+			if (opcode & 1) {
+				zoom = _scriptVars[_scriptPtr.fetchByte()];
 			}
 		} else {
-			if (_is3DO) {
-				switch (opcode) {
-				case 11: {
-						const int num = _scriptPtr.fetchByte();
-						debug(DBG_SCRIPT, "Script::op11() setPalette %d", num);
-						_vid->changePal(num);
-					}
-					continue;
-				case 22: {
-						const int var = _scriptPtr.fetchByte();
-						const int shift = _scriptPtr.fetchByte();
-						debug(DBG_SCRIPT, "Script::op22() VAR(0x%02X) <<= %d", var, shift);
-						_scriptVars[var] = (uint16_t)_scriptVars[var] << shift;
-					}
-					continue;
-				case 23: {
-						const int var = _scriptPtr.fetchByte();
-						const int shift  = _scriptPtr.fetchByte();
-						debug(DBG_SCRIPT, "Script::op23() VAR(0x%02X) >>= %d", var, shift);
-						_scriptVars[var] = (uint16_t)_scriptVars[var] >> shift;
-					}
-					continue;
-				case 26: {
-						const int num = _scriptPtr.fetchByte();
-						debug(DBG_SCRIPT, "Script::op26() playMusic %d", num);
-						snd_playMusic(num, 0, 0);
-					}
-					continue;
-				case 27: {
-						const int num = _scriptPtr.fetchWord();
-						const int x = _scriptVars[_scriptPtr.fetchByte()];
-						const int y = _scriptVars[_scriptPtr.fetchByte()];
-						const int color = _scriptPtr.fetchByte();
-						_vid->drawString(color, x, y, num);
-					}
-					continue;
-				case 28: {
-						const uint8_t var = _scriptPtr.fetchByte();
-						debug(DBG_SCRIPT, "Script::op28() jmpIf(VAR(0x%02X) == 0)");
-						if (_scriptVars[var] == 0) {
-							op_jmp();
-						} else {
-							_scriptPtr.fetchWord();
-						}
-					}
-					continue;
-				case 29: {
-						const uint8_t var = _scriptPtr.fetchByte();
-						debug(DBG_SCRIPT, "Script::op29() jmpIf(VAR(0x%02X) != 0)");
-						if (_scriptVars[var] != 0) {
-							op_jmp();
-						} else {
-							_scriptPtr.fetchWord();
-						}
+			if (opcode & 1) {
+				_res->_useSegVideo2 = true;
+			} else {
+				zoom = _scriptPtr.fetchByte();
+			}
+		}
+		debug(DBG_VIDEO, "vid_opcd_0x40 : off=0x%X x=%d y=%d", off, pt.x, pt.y);
+		_vid->setDataBuffer(_res->_useSegVideo2 ? _res->_segVideo2 : _res->_segVideo1, off);
+		if (_is3DO) {
+			_vid->drawShape3DO(0xFF, zoom, &pt);
+		} else {
+			_vid->drawShape(0xFF, zoom, &pt);
+		}
+	} else {
+		if (_is3DO) {
+			switch (opcode) {
+			case 11: {
+					const int num = _scriptPtr.fetchByte();
+					debug(DBG_SCRIPT, "Script::op11() setPalette %d", num);
+					_vid->changePal(num);
+				}
+				return;
+			case 22: {
+					const int var = _scriptPtr.fetchByte();
+					const int shift = _scriptPtr.fetchByte();
+					debug(DBG_SCRIPT, "Script::op22() VAR(0x%02X) <<= %d", var, shift);
+					_scriptVars[var] = (uint16_t)_scriptVars[var] << shift;
+				}
+				return;
+			case 23: {
+					const int var = _scriptPtr.fetchByte();
+					const int shift  = _scriptPtr.fetchByte();
+					debug(DBG_SCRIPT, "Script::op23() VAR(0x%02X) >>= %d", var, shift);
+					_scriptVars[var] = (uint16_t)_scriptVars[var] >> shift;
+				}
+				return;
+			case 26: {
+					const int num = _scriptPtr.fetchByte();
+					debug(DBG_SCRIPT, "Script::op26() playMusic %d", num);
+					snd_playMusic(num, 0, 0);
+				}
+				return;
+			case 27: {
+					const int num = _scriptPtr.fetchWord();
+					const int x = _scriptVars[_scriptPtr.fetchByte()];
+					const int y = _scriptVars[_scriptPtr.fetchByte()];
+					const int color = _scriptPtr.fetchByte();
+					_vid->drawString(color, x, y, num);
+				}
+				return;
+			case 28: {
+					const uint8_t var = _scriptPtr.fetchByte();
+					debug(DBG_SCRIPT, "Script::op28() jmpIf(VAR(0x%02X) == 0)");
+					if (_scriptVars[var] == 0) {
+						op_jmp();
+					} else {
+						_scriptPtr.fetchWord();
 					}
-					continue;
-				case 30: {
-						fprintf(stdout, "Time = %d", _scriptVars[0xF7]);
+				}
+				return;
+			case 29: {
+					const uint8_t var = _scriptPtr.fetchByte();
+					debug(DBG_SCRIPT, "Script::op29() jmpIf(VAR(0x%02X) != 0)");
+					if (_scriptVars[var] != 0) {
+						op_jmp();
+					} else {
+						_scriptPtr.fetchWord();
 					}
-					continue;
 				}
+				return;
+			case 30: {
+					fprintf(stdout, "Time = %d", _scriptVars[0xF7]);
+				}
+				return;
 			}
-			if (opcode > 0x1A) {
-				error("Script::executeTask() ec=0x%X invalid opcode=0x%X", 0xFFF, opcode);
-			} else {
-				(this->*_opTable[opcode])();
-			}
+		}
+		if (opcode > 0x1A) {
+			error("Script::executeTask() ec=0x%X invalid opcode=0x%X", 0xFFF, opcode);
+		} else {
+			(this->*_opTable[opcode])();
 		}
 	}
 }
@@ -770,9 +1034,10 @@ void Script::snd_playSound(uint16_t resNum, uint8_t freq, uint8_t vol, uint8_t c
 		}
 		/* fall-through */
 	case Resource::DT_WIN31: {
-			uint8_t *buf = _res->loadWav(resNum);
+			int *ref;
+			uint8_t *buf = _res->loadWav(resNum, &ref);
 			if (buf) {
-				_mix->playSoundWav(channel, buf, getSoundFreq(freq), vol, getWavLooping(resNum));
+				_mix->playSoundWav(channel, buf, getSoundFreq(freq), vol, getWavLooping(resNum), ref);
 			}
 		}
 		break;
@@ -8,6 +8,7 @@
 #define SCRIPT_H__
 
 #include "intern.h"
+#include "scriptcode.h"
 
 struct Mixer;
 struct Resource;
@@ -66,6 +67,7 @@ struct Script {
 	int _screenNum;
 	bool _is3DO;
 	uint32_t _startTime, _timeStamp;
+	ScriptCode _code;
 
 	Script(Mixer *mix, Resource *res, SfxPlayer *ply, Video *vid);
 	void init();
@@ -103,6 +105,8 @@ struct Script {
 	void setupTasks();
 	void runTasks();
 	void executeTask();
+	void executeTaskProfile(int task);
+	void executeInstruction();
 
 	void updateInput();
 	void inp_handleSpecialKeys();
@@ -0,0 +1,376 @@
+
+#include "scriptcode.h"
+#include "util.h"
+
+ScriptCode::ScriptCode()
+	: _seg(0), _size(0), _part(0), _is3DO(false), _gunWorkaround(false), _index(0) {
+}
+
+ScriptCode::~ScriptCode() {
+	free(_index);
+}
+
+void ScriptCode::reset(const uint8_t *seg, uint32_t size, int part, bool is3DO, bool gunWorkaround) {
+	if (seg == _seg && size == _size && part == _part && _index) {
+		return;
+	}
+	_seg = seg;
+	_size = MIN(size, (uint32_t)0x10000);
+	_part = part;
+	_is3DO = is3DO;
+	_gunWorkaround = gunWorkaround;
+	_insns.clear();
+	if (!_index) {
+		_index = (uint16_t *)malloc(0x10000 * sizeof(uint16_t));
+		if (!_index) {
+			warning("Unable to allocate script code index");
+			return;
+		}
+	}
+	memset(_index, 0xFF, 0x10000 * sizeof(uint16_t));
+	if (_seg) {
+		decode(0);
+		debug(DBG_SCRIPT, "ScriptCode::reset() part %d, %d instructions", part, (int)_insns.size());
+	}
+}
+
+int ScriptCode::getInsn(uint16_t offset) {
+	if (!_index || !_seg) {
+		return -1;
+	}
+	if (_index[offset] == kNone) {
+		decode(offset);
+	}
+	return (_index[offset] == kNone) ? -1 : _index[offset];
+}
+
+void ScriptCode::decode(uint16_t offset) {
+	const int first = _insns.size();
+	std::vector<uint16_t> pending;
+	pending.push_back(offset);
+	while (!pending.empty()) {
+		const uint16_t pos = pending.back();
+		pending.pop_back();
+		if (_index[pos] != kNone) {
+			continue;
+		}
+		// the instruction indexes fit in 16 bits, one byte at least per instruction
+		assert(_insns.size() < kNone);
+		ScriptInsn insn;
+		if (!decodeInsn(pos, &insn, pending)) {
+			continue;
+		}
+		_index[pos] = _insns.size();
+		_insns.push_back(insn);
+	}
+	// link the new instructions, the targets and the following instructions were all decoded
+	for (size_t i = first; i < _insns.size(); ++i) {
+		ScriptInsn *insn = &_insns[i];
+		const uint32_t next = insn->offset + insn->size;
+		insn->next = (next < 0x10000) ? _index[next] : kNone;
+		switch (insn->op) {
+		case kInsnCall:
+		case kInsnJmp:
+		case kInsnJmpIfVar:
+		case kInsnJmpIfEq:
+		case kInsnJmpIfNe:
+		case kInsnJmpIfGt:
+		case kInsnJmpIfGe:
+		case kInsnJmpIfLt:
+		case kInsnJmpIfLe:
+			insn->target = _index[insn->n];
+			break;
+		default:
+			insn->target = kNone;
+			break;
+		}
+		// leave the instructions with an undecoded successor to the handlers
+		const bool end = (insn->op == kInsnJmp || insn->op == kInsnRet || insn->op == kInsnRemoveTask || insn->op == kInsnYieldTask);
+		const bool jump = (insn->op == kInsnCall || insn->op == kInsnJmp || insn->op == kInsnJmpIfVar || (insn->op >= kInsnJmpIfEq && insn->op <= kInsnJmpIfLe));
+		if ((!end && insn->next == kNone) || (jump && insn->target == kNone)) {
+			insn->op = kInsnGeneric;
+		}
+		insn->baseOp = insn->op;
+	}
+	fuse(first);
+}
+
+static const struct {
+	uint8_t op1, op2, op3; // kInsnOpsCount for a pair
+	uint8_t fused;
+} _fusions[] = {
+	// sequences found the most often in the game code, see the opcode pairs printed by tools/disasm
+	{ kInsnMovConst, kInsnMovConst, kInsnMovConst, kInsnMovConst3 },
+	{ kInsnMovConst, kInsnMovConst, kInsnOpsCount, kInsnMovConst2 },
+	{ kInsnJmpIfEq, kInsnJmp, kInsnOpsCount, kInsnCondJmpJmp },
+	{ kInsnJmpIfNe, kInsnJmp, kInsnOpsCount, kInsnCondJmpJmp },
+	{ kInsnJmpIfGt, kInsnJmp, kInsnOpsCount, kInsnCondJmpJmp },
+	{ kInsnJmpIfGe, kInsnJmp, kInsnOpsCount, kInsnCondJmpJmp },
+	{ kInsnJmpIfLt, kInsnJmp, kInsnOpsCount, kInsnCondJmpJmp },
+	{ kInsnJmpIfLe, kInsnJmp, kInsnOpsCount, kInsnCondJmpJmp },
+	{ kInsnAddConst, kInsnJmpIfVar, kInsnOpsCount, kInsnAddConstJmpIfVar },
+};
+
+void ScriptCode::fuse(int first) {
+	// the fused instructions stay in the stream, a jump or a return to them runs them alone
+	int count = 0;
+	for (size_t i = first; i < _insns.size(); ++i) {
+		ScriptInsn *insn = &_insns[i];
+		for (size_t j = 0; j < ARRAYSIZE(_fusions); ++j) {
+			if (insn->baseOp != _fusions[j].op1) {
+				continue;
+			}
+			// the handled instructions are linked to the following ones, 'next' is set
+			const ScriptInsn *insn2 = &_insns[insn->next];
+			if (insn2->baseOp != _fusions[j].op2) {
+				continue;
+			}
+			if (_fusions[j].op3 != kInsnOpsCount && _insns[insn2->next].baseOp != _fusions[j].op3) {
+				continue;
+			}
+			insn->op = _fusions[j].fused;
+			++count;
+			break;
+		}
+	}
+	debug(DBG_SCRIPT, "ScriptCode::fuse() %d superinstructions", count);
+}
+
+bool ScriptCode::decodeInsn(uint16_t offset, ScriptInsn *insn, std::vector<uint16_t> &pending) {
+	// the instructions close to the end of the segment are left to the handlers, the decoder reads ahead
+	if ((uint32_t)offset + kMaxInsnSize > _size) {
+		debug(DBG_SCRIPT, "ScriptCode::decodeInsn() offset 0x%X out of range", offset);
+		return false;
+	}
+	Ptr p;
+	p.pc = (uint8_t *)_seg + offset;
+	p.byteSwap = _is3DO;
+	memset(insn, 0, sizeof(ScriptInsn));
+	const uint8_t opcode = p.fetchByte();
+	insn->opcode = opcode;
+	insn->offset = offset;
+	insn->op = kInsnGeneric;
+	bool fallThrough = true;
+	if (opcode & 0x80) {
+		const uint16_t off = ((opcode << 8) | p.fetchByte()) << 1;
+		Point pt;
+		pt.x = p.fetchByte();
+		pt.y = p.fetchByte();
+		int16_t h = pt.y - 199;
+		if (h > 0) {
+			pt.y = 199;
+			pt.x += h;
+		}
+		insn->op = kInsnDrawShape;
+		insn->n = off;
+		insn->x = pt.x;
+		insn->y = pt.y;
+		insn->zoom = 64;
+	} else if (opcode & 0x40) {
+		const uint8_t offsetHi = p.fetchByte();
+		insn->op = kInsnDrawShapeZoom;
+		insn->n = ((offsetHi << 8) | p.fetchByte()) << 1;
+		insn->x = p.fetchByte();
+		if (!(opcode & 0x20)) {
+			if (!(opcode & 0x10)) {
+				insn->x = (insn->x << 8) | p.fetchByte();
+			} else {
+				insn->flags |= kInsnVarX;
+			}
+		} else {
+			if (opcode & 0x10) {
+				insn->x += 0x100;
+			}
+		}
+		insn->y = p.fetchByte();
+		if (!(opcode & 8)) {
+			if (!(opcode & 4)) {
+				insn->y = (insn->y << 8) | p.fetchByte();
+			} else {
+				insn->flags |= kInsnVarY;
+			}
+		}
+		insn->zoom = 64;
+		if (!(opcode & 2)) {
+			if (opcode & 1) {
+				insn->zoom = p.fetchByte();
+				insn->flags |= kInsnVarZoom;
+			}
+		} else {
+			if (opcode & 1) {
+				insn->flags |= kInsnSegVideo2;
+			} else {
+				insn->zoom = p.fetchByte();
+			}
+		}
+	} else if (_is3DO && (opcode == 11 || opcode == 22 || opcode == 23 || opcode >= 26)) {
+		// opcodes specific to the 3DO version
+		switch (opcode) {
+		case 11:
+		case 26:
+			p.pc += 1;
+			break;
+		case 22:
+		case 23:
+			p.pc += 2;
+			break;
+		case 27:
+			p.pc += 5;
+			break;
+		case 28:
+		case 29:
+			p.fetchByte();
+			pending.push_back(p.fetchWord());
+			break;
+		case 30:
+			break;
+		default:
+			fallThrough = false;
+			break;
+		}
+	} else {
+		switch (opcode) {
+		case 0x00:
+			insn->op = kInsnMovConst;
+			insn->a = p.fetchByte();
+			insn->n = p.fetchWord();
+			break;
+		case 0x01:
+			insn->op = kInsnMov;
+			insn->a = p.fetchByte();
+			insn->n = p.fetchByte();
+			break;
+		case 0x02:
+			insn->op = kInsnAdd;
+			insn->a = p.fetchByte();
+			insn->n = p.fetchByte();
+			break;
+		case 0x03:
+			// the infinite looping gun sound workaround checks the position of the instruction
+			if (!(_gunWorkaround && _part == 16006 && offset == 0x6D47)) {
+				insn->op = kInsnAddConst;
+			}
+			insn->a = p.fetchByte();
+			insn->n = p.fetchWord();
+			break;
+		case 0x04:
+			insn->op = kInsnCall;
+			insn->n = p.fetchWord();
+			pending.push_back(insn->n);
+			break;
+		case 0x05:
+			insn->op = kInsnRet;
+			fallThrough = false;
+			break;
+		case 0x06:
+			insn->op = kInsnYieldTask;
+			break;
+		case 0x07:
+			insn->op = kInsnJmp;
+			insn->n = p.fetchWord();
+			pending.push_back(insn->n);
+			fallThrough = false;
+			break;
+		case 0x08:
+			insn->op = kInsnInstallTask;
+			insn->a = p.fetchByte();
+			insn->n = p.fetchWord();
+			pending.push_back(insn->n);
+			break;
+		case 0x09:
+			insn->op = kInsnJmpIfVar;
+			insn->a = p.fetchByte();
+			insn->n = p.fetchWord();
+			pending.push_back(insn->n);
+			break;
+		case 0x0A: {
+				const uint8_t op = p.fetchByte();
+				const uint8_t var = p.fetchByte();
+				uint16_t rhs;
+				if (op & 0x80) {
+					rhs = p.fetchByte();
+					insn->flags |= kInsnVarRhs;
+				} else if (op & 0x40) {
+					rhs = p.fetchWord();
+				} else {
+					rhs = p.fetchByte();
+				}
+				const uint16_t target = p.fetchWord();
+				pending.push_back(target);
+				// the screen number and the protection checks have side effects, kept in the handler
+				if ((op & 7) <= 5 && !(!_is3DO && var == 0x67) && !(_part == kPartCopyProtection && var == 0x29)) {
+					static const uint8_t ops[] = { kInsnJmpIfEq, kInsnJmpIfNe, kInsnJmpIfGt, kInsnJmpIfGe, kInsnJmpIfLt, kInsnJmpIfLe };
+					insn->op = ops[op & 7];
+					insn->a = var;
+					insn->x = rhs;
+					insn->n = target;
+				}
+			}
+			break;
+		case 0x0B:
+			p.pc += 2;
+			break;
+		case 0x0C: {
+				const uint8_t start = p.fetchByte();
+				const uint8_t end = p.fetchByte();
+				if (end >= start) {
+					p.pc += 1;
+				}
+			}
+			break;
+		case 0x0D:
+			p.pc += 1;
+			break;
+		case 0x0E:
+		case 0x0F:
+			p.pc += 2;
+			break;
+		case 0x10:
+			p.pc += 1;
+			break;
+		case 0x11:
+			insn->op = kInsnRemoveTask;
+			fallThrough = false;
+			break;
+		case 0x12:
+			p.pc += 5;
+			break;
+		case 0x13:
+			insn->op = kInsnSub;
+			insn->a = p.fetchByte();
+			insn->n = p.fetchByte();
+			break;
+		case 0x14:
+		case 0x15:
+		case 0x16:
+		case 0x17: {
+				static const uint8_t ops[] = { kInsnAnd, kInsnOr, kInsnShl, kInsnShr };
+				insn->op = ops[opcode - 0x14];
+				insn->a = p.fetchByte();
+				insn->n = p.fetchWord();
+			}
+			break;
+		case 0x18:
+			p.pc += 5;
+			break;
+		case 0x19:
+			p.pc += 2;
+			break;
+		case 0x1A:
+			p.pc += 5;
+			break;
+		default:
+			// invalid opcode, reported by the handler
+			fallThrough = false;
+			break;
+		}
+	}
+	insn->size = p.pc - (_seg + offset);
+	if (fallThrough) {
+		const uint32_t next = offset + insn->size;
+		if (next < _size) {
+			pending.push_back(next);
+		}
+	}
+	return true;
+}
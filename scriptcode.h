@@ -0,0 +1,90 @@
+
+#ifndef SCRIPTCODE_H__
+#define SCRIPTCODE_H__
+
+#include <vector>
+#include "intern.h"
+
+enum ScriptInsnOp {
+	kInsnMovConst,
+	kInsnMov,
+	kInsnAdd,
+	kInsnAddConst,
+	kInsnCall,
+	kInsnRet,
+	kInsnYieldTask,
+	kInsnJmp,
+	kInsnInstallTask,
+	kInsnJmpIfVar,
+	kInsnJmpIfEq,
+	kInsnJmpIfNe,
+	kInsnJmpIfGt,
+	kInsnJmpIfGe,
+	kInsnJmpIfLt,
+	kInsnJmpIfLe,
+	kInsnRemoveTask,
+	kInsnSub,
+	kInsnAnd,
+	kInsnOr,
+	kInsnShl,
+	kInsnShr,
+	kInsnDrawShape, // opcode & 0x80
+	kInsnDrawShapeZoom, // opcode & 0x40
+	// superinstructions, the following instructions are read from 'next'
+	kInsnCondJmpJmp, // jmpIf* + jmp
+	kInsnMovConst2, // movConst + movConst
+	kInsnMovConst3, // movConst + movConst + movConst
+	kInsnAddConstJmpIfVar, // addConst + jmpIfVar
+	kInsnGeneric, // executed by the Script::_opTable handler
+	kInsnOpsCount
+};
+
+enum {
+	kInsnVarX = 1 << 0,
+	kInsnVarY = 1 << 1,
+	kInsnVarZoom = 1 << 2,
+	kInsnSegVideo2 = 1 << 3,
+	kInsnVarRhs = 1 << 4
+};
+
+struct ScriptInsn {
+	uint8_t op;
+	uint8_t baseOp; // op before fusion
+	uint8_t opcode; // bytecode opcode
+	uint8_t a; // variable
+	uint8_t flags;
+	uint16_t n; // constant, variable or jump offset
+	int16_t x, y;
+	uint16_t zoom;
+	uint16_t offset, size; // position in the bytecode
+	uint16_t next, target; // instruction indexes
+};
+
+// bytecode of a part decoded to instructions with their operands, following the control flow from the entry points
+struct ScriptCode {
+	enum {
+		kNone = 0xFFFF,
+		kMaxInsnSize = 8
+	};
+
+	const uint8_t *_seg;
+	uint32_t _size;
+	int _part;
+	bool _is3DO;
+	bool _gunWorkaround;
+	std::vector<ScriptInsn> _insns;
+	uint16_t *_index; // instruction index for each bytecode offset
+
+	ScriptCode();
+	~ScriptCode();
+
+	void reset(const uint8_t *seg, uint32_t size, int part, bool is3DO, bool gunWorkaround);
+	int getInsn(uint16_t offset);
+	const ScriptInsn *insns() const { return &_insns[0]; }
+
+	void decode(uint16_t offset);
+	void fuse(int first);
+	bool decodeInsn(uint16_t offset, ScriptInsn *insn, std::vector<uint16_t> &pending);
+};
+
+#endif
@@ -0,0 +1,92 @@
+
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "scriptprofile.h"
+#include "util.h"
+
+FILE *ScriptProfile::_fp = 0;
+ScriptProfile::Entry ScriptProfile::_opcodes[256];
+ScriptProfile::Entry ScriptProfile::_tasks[64];
+std::map<uint32_t, ScriptProfile::Entry> ScriptProfile::_addrs;
+std::map<uint32_t, ScriptProfile::Entry> ScriptProfile::_shapes;
+
+bool ScriptProfile::open(const char *path) {
+	close();
+	_fp = fopen(path, "w");
+	if (!_fp) {
+		warning("Unable to open '%s' for writing", path);
+		return false;
+	}
+	return true;
+}
+
+static void addEntry(ScriptProfile::Entry *e, uint64_t time) {
+	++e->count;
+	e->time += time;
+}
+
+static bool compareTime(const std::pair<uint32_t, ScriptProfile::Entry> &a, const std::pair<uint32_t, ScriptProfile::Entry> &b) {
+	return a.second.time > b.second.time;
+}
+
+void ScriptProfile::close() {
+	if (!_fp) {
+		return;
+	}
+	fprintf(_fp, "# opcode count ns\n");
+	for (int i = 0; i < 256; ++i) {
+		if (_opcodes[i].count != 0) {
+			fprintf(_fp, "opcode 0x%02X %d %lld\n", i, _opcodes[i].count, (long long)_opcodes[i].time);
+		}
+	}
+	fprintf(_fp, "# task count ns\n");
+	for (int i = 0; i < 64; ++i) {
+		if (_tasks[i].count != 0) {
+			fprintf(_fp, "task %d %d %lld\n", i, _tasks[i].count, (long long)_tasks[i].time);
+		}
+	}
+	// the hottest first
+	std::vector<std::pair<uint32_t, Entry> > entries(_shapes.begin(), _shapes.end());
+	std::sort(entries.begin(), entries.end(), compareTime);
+	fprintf(_fp, "# shape part segment offset count ns\n");
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const uint32_t key = entries[i].first;
+		fprintf(_fp, "shape %d %d 0x%04X %d %lld\n", key >> 17, ((key >> 16) & 1) + 1, key & 0xFFFF, entries[i].second.count, (long long)entries[i].second.time);
+	}
+	entries.assign(_addrs.begin(), _addrs.end());
+	std::sort(entries.begin(), entries.end(), compareTime);
+	fprintf(_fp, "# addr part address count ns\n");
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const uint32_t key = entries[i].first;
+		fprintf(_fp, "addr %d 0x%04X %d %lld\n", key >> 16, key & 0xFFFF, entries[i].second.count, (long long)entries[i].second.time);
+	}
+	fclose(_fp);
+	_fp = 0;
+}
+
+uint64_t ScriptProfile::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void ScriptProfile::record(int part, int task, const uint8_t *seg, uint16_t addr, uint64_t start) {
+	const uint64_t time = now() - start;
+	const uint8_t *p = seg + addr;
+	const uint8_t opcode = p[0];
+	if (opcode & 0x80) {
+		const uint16_t offset = ((opcode << 8) | p[1]) << 1;
+		addEntry(&_opcodes[0x80], time);
+		addEntry(&_shapes[((uint32_t)part << 17) | offset], time);
+	} else if (opcode & 0x40) {
+		const uint16_t offset = ((p[1] << 8) | p[2]) << 1;
+		const int segVideo2 = ((opcode & 3) == 3) ? 1 : 0;
+		addEntry(&_opcodes[0x40], time);
+		addEntry(&_shapes[((uint32_t)part << 17) | (segVideo2 << 16) | offset], time);
+	} else {
+		addEntry(&_opcodes[opcode], time);
+	}
+	addEntry(&_tasks[task & 63], time);
+	addEntry(&_addrs[((uint32_t)part << 16) | addr], time);
+}
@@ -0,0 +1,27 @@
+
+#ifndef SCRIPTPROFILE_H__
+#define SCRIPTPROFILE_H__
+
+#include <map>
+#include "intern.h"
+
+// execution counts and times of the script instructions, written to a file at exit
+struct ScriptProfile {
+	struct Entry {
+		uint32_t count;
+		uint64_t time; // nanoseconds
+	};
+
+	static FILE *_fp;
+	static Entry _opcodes[256]; // 0x40 and 0x80 for the shapes
+	static Entry _tasks[64];
+	static std::map<uint32_t, Entry> _addrs; // part << 16 | address
+	static std::map<uint32_t, Entry> _shapes; // part << 17 | segVideo2 << 16 | offset
+
+	static bool open(const char *path);
+	static void close();
+	static uint64_t now();
+	static void record(int part, int task, const uint8_t *seg, uint16_t addr, uint64_t start);
+};
+
+#endif
@@ -0,0 +1,68 @@
+
+#include "soundcache.h"
+#include "util.h"
+
+static const uint32_t kDefaultSize = 16 * 1024 * 1024;
+
+SoundCache::SoundCache()
+	: _size(0), _maxSize(kDefaultSize) {
+}
+
+SoundCache::~SoundCache() {
+	clear();
+}
+
+void SoundCache::evict(uint32_t size) {
+	std::list<SoundCacheEntry>::iterator it = _entries.end();
+	while (it != _entries.begin() && _size + size > _maxSize) {
+		--it;
+		if (it->ref == 0) {
+			if (!it->mapped) {
+				_size -= it->size;
+				free(it->data);
+			}
+			it = _entries.erase(it);
+		}
+	}
+}
+
+SoundCacheEntry *SoundCache::find(const char *name) {
+	for (std::list<SoundCacheEntry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+		if (it->name == name) {
+			if (it != _entries.begin()) {
+				_entries.splice(_entries.begin(), _entries, it);
+			}
+			return &_entries.front();
+		}
+	}
+	return 0;
+}
+
+SoundCacheEntry *SoundCache::add(const char *name, uint8_t *data, uint32_t size, bool mapped) {
+	// mapped data is shared with the page cache and does not count in the budget
+	if (!mapped) {
+		evict(size);
+	}
+	SoundCacheEntry e;
+	e.name = name;
+	e.data = data;
+	e.size = size;
+	e.ref = 0;
+	e.mapped = mapped;
+	_entries.push_front(e);
+	if (!mapped) {
+		_size += size;
+	}
+	debug(DBG_SND, "SoundCache::add() '%s' size %d total %d", name, size, _size);
+	return &_entries.front();
+}
+
+void SoundCache::clear() {
+	for (std::list<SoundCacheEntry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+		if (!it->mapped) {
+			free(it->data);
+		}
+	}
+	_entries.clear();
+	_size = 0;
+}
@@ -0,0 +1,32 @@
+
+#ifndef SOUNDCACHE_H__
+#define SOUNDCACHE_H__
+
+#include <list>
+#include <string>
+#include "intern.h"
+
+struct SoundCacheEntry {
+	std::string name;
+	uint8_t *data;
+	uint32_t size;
+	int ref; // mixer channels playing the sound
+	bool mapped; // data is a mapping of the disk cache or of the data files, not owned
+};
+
+// loaded sound files, least recently used are evicted first unless they are playing
+struct SoundCache {
+	std::list<SoundCacheEntry> _entries;
+	uint32_t _size;
+	uint32_t _maxSize;
+
+	SoundCache();
+	~SoundCache();
+
+	SoundCacheEntry *find(const char *name);
+	SoundCacheEntry *add(const char *name, uint8_t *data, uint32_t size, bool mapped = false);
+	void clear();
+	void evict(uint32_t size);
+};
+
+#endif
@@ -1,6 +1,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <sys/param.h>
@@ -16,6 +17,11 @@ enum {
 static uint8_t _fileBuf[MAX_FILESIZE];
 static char _shapeNames[MAX_SHAPENAMES][7]; // shape (polygons) names are 6 characters long
 static int _histogramOp[MAX_OPCODES];
+static int _histogramPair[MAX_OPCODES + 2][MAX_OPCODES + 2]; // consecutive opcodes, the last two for the shapes
+static int _prevOp = -1;
+
+static uint32_t _profileCount[MAX_FILESIZE]; // from the file written by rawgl --profile
+static uint64_t _profileTime[MAX_FILESIZE];
 
 static bool _is3DO = false;
 
@@ -148,7 +154,39 @@ static void checkOpcode(uint16_t addr, uint8_t opcode, int args[16]) {
 		const int offset = args[1];
 		_addr[offset] |= ADDR_LABEL;
 	}
-	++_histogramOp[opcode];
+	if (opcode < MAX_OPCODES) {
+		++_histogramOp[opcode];
+	}
+	if (addr == 0) {
+		_prevOp = -1;
+	}
+	const int op = (opcode & 0x80) ? MAX_OPCODES + 1 : ((opcode & 0x40) ? MAX_OPCODES : opcode);
+	if (_prevOp >= 0 && op < MAX_OPCODES + 2) {
+		++_histogramPair[_prevOp][op];
+	}
+	// no pair after an unconditional jump
+	_prevOp = (op == op_jmp || op == op_ret || op == op_removeTask || op >= MAX_OPCODES + 2) ? -1 : op;
+}
+
+static void printPairs(int count) {
+	for (int n = 0; n < count; ++n) {
+		int best = 0, a = 0, b = 0;
+		for (int i = 0; i < MAX_OPCODES + 2; ++i) {
+			for (int j = 0; j < MAX_OPCODES + 2; ++j) {
+				if (_histogramPair[i][j] > best) {
+					best = _histogramPair[i][j];
+					a = i;
+					b = j;
+				}
+			}
+		}
+		if (best == 0) {
+			break;
+		}
+		fprintf(stdout, "%d,%d:%d ", a, b, best);
+		_histogramPair[a][b] = 0;
+	}
+	fprintf(stdout, "\n");
 }
 
 static void printOpcode(uint16_t addr, uint8_t opcode, int args[16]) {
@@ -317,6 +355,9 @@ static void printOpcode(uint16_t addr, uint8_t opcode, int args[16]) {
 		}
 		break;
 	}
+	if (_profileCount[addr] != 0) {
+		fprintf(_out, " // count=%d time=%dus", _profileCount[addr], (int)(_profileTime[addr] / 1000));
+	}
 	fputc('\n', _out);
 }
 
@@ -529,13 +570,42 @@ static int readFile(const char *path) {
 	return size;
 }
 
+static void readProfile(const char *path, int part) {
+	memset(_profileCount, 0, sizeof(_profileCount));
+	memset(_profileTime, 0, sizeof(_profileTime));
+	FILE *fp = fopen(path, "r");
+	if (fp) {
+		char buf[256];
+		while (fgets(buf, sizeof(buf), fp)) {
+			int num, count;
+			unsigned int addr;
+			long long time;
+			if (sscanf(buf, "addr %d %x %d %lld", &num, &addr, &count, &time) == 4) {
+				if ((part == 0 || num == part) && addr < MAX_FILESIZE) {
+					_profileCount[addr] += count;
+					_profileTime[addr] += time;
+				}
+			}
+		}
+		fclose(fp);
+	} else {
+		fprintf(stderr, "Failed to open '%s'\n", path);
+	}
+}
+
 static const char *NAMES[] = { 0, "intro", "eau", "pri", "cite", "arene", "luxe", "final", 0 };
 static const uint8_t RES[] = { 0x15, 0x18, 0x1B, 0x1E, 0x21, 0x24, 0x27, 0x2A, 0x7E };
 
 int main(int argc, char *argv[]) {
-	if (argc >= 3) {
+	const char *profilePath = 0;
+	int part = 0;
+	while (argc >= 3 && argv[1][0] == '-') {
 		if (strcmp(argv[1], "-3do") == 0) {
 			_is3DO = true;
+		} else if (strncmp(argv[1], "-profile=", 9) == 0) {
+			profilePath = argv[1] + 9;
+		} else if (strncmp(argv[1], "-part=", 6) == 0) {
+			part = atoi(argv[1] + 6);
 		}
 		--argc;
 		++argv;
@@ -553,6 +623,9 @@ int main(int argc, char *argv[]) {
 					readShapeNames(_fileBuf, size);
 				}
 			}
+			if (profilePath) {
+				readProfile(profilePath, part);
+			}
 			const int size = readFile(argv[1]);
 			if (size != 0) {
 				visitOpcode = checkOpcode;
@@ -572,6 +645,9 @@ int main(int argc, char *argv[]) {
 				} else {
 					snprintf(path, sizeof(path), "%d.asm", 16000 + i);
 				}
+				if (profilePath) {
+					readProfile(profilePath, 16000 + i);
+				}
 				_out = fopen(path, "wb");
 				if (_out) {
 					memset(_addr, 0, sizeof(_addr));
@@ -589,8 +665,9 @@ int main(int argc, char *argv[]) {
 			}
 		}
 		fprintf(stdout, "\n");
+		printPairs(16);
 	} else {
-		fprintf(stdout, "Usage: %s [-3do] /path/to/File%%d\n", argv[0]);
+		fprintf(stdout, "Usage: %s [-3do] [-profile=FILE [-part=NUM]] /path/to/File%%d\n", argv[0]);
 	}
 	return 0;
 }
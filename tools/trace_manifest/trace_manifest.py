@@ -0,0 +1,46 @@
+#!/usr/bin/env python
+#
+# Aggregate the files written with --trace into a per part preload manifest.
+#
+# Each manifest line is 'part kind num bytes loads us' with the resources of a
+# part listed in the order they were first loaded. The requests of the game
+# script which triggered the loads are given as a comment after each part.
+
+import sys
+
+def read_trace(path, parts):
+	with open(path) as f:
+		for line in f:
+			line = line.strip()
+			if not line or line.startswith('#'):
+				continue
+			kind, num, size, us, part, request = line.split()
+			entries, requests = parts.setdefault(int(part), ({}, []))
+			key = (kind, int(num))
+			if key not in entries:
+				entries[key] = [ len(entries), int(size), 0, 0 ]
+			e = entries[key]
+			e[1] = max(e[1], int(size))
+			e[2] += 1
+			e[3] += int(us)
+			request = int(request)
+			if request != 0 and request not in requests:
+				requests.append(request)
+
+if len(sys.argv) < 2:
+	print('Usage: %s TRACE...' % sys.argv[0])
+	sys.exit(1)
+
+parts = {}
+for path in sys.argv[1:]:
+	read_trace(path, parts)
+
+for part in sorted(parts.keys()):
+	entries, requests = parts[part]
+	total_size = sum(e[1] for e in entries.values())
+	total_us = sum(e[3] for e in entries.values())
+	print('# part %d : %d resources, %d bytes, %d us' % (part, len(entries), total_size, total_us))
+	if requests:
+		print('# requests %s' % ' '.join(str(r) for r in requests))
+	for key, e in sorted(entries.items(), key=lambda kv: kv[1][0]):
+		print('%d %s %d %d %d %d' % (part, key[0], key[1], e[1], e[2], e[3]))
@@ -4,37 +4,43 @@
  * Copyright (C) 2004-2005 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <string.h>
 #include "unpack.h"
 #include "util.h"
 
 struct UnpackCtx {
 	int size;
 	uint32_t crc;
-	uint32_t bits;
+	uint64_t bits; // pending bits, next bit to read is the most significant one
+	int bitsCount;
 	uint8_t *dst;
 	const uint8_t *src;
 };
 
-static bool nextBit(UnpackCtx *uc) {
-	bool carry = (uc->bits & 1) != 0;
-	uc->bits >>= 1;
-	if (uc->bits == 0) { // getnextlwd
-		uc->bits = READ_BE_UINT32(uc->src); uc->src -= 4;
-		uc->crc ^= uc->bits;
-		carry = (uc->bits & 1) != 0;
-		uc->bits = (1 << 31) | (uc->bits >> 1);
-	}
-	return carry;
+static uint32_t reverseBits(uint32_t n) {
+	n = ((n >> 1) & 0x55555555) | ((n & 0x55555555) << 1);
+	n = ((n >> 2) & 0x33333333) | ((n & 0x33333333) << 2);
+	n = ((n >> 4) & 0x0F0F0F0F) | ((n & 0x0F0F0F0F) << 4);
+	n = ((n >> 8) & 0x00FF00FF) | ((n & 0x00FF00FF) << 8);
+	return (n >> 16) | (n << 16);
+}
+
+static void refill(UnpackCtx *uc) { // getnextlwd
+	const uint32_t lwd = READ_BE_UINT32(uc->src); uc->src -= 4;
+	uc->crc ^= lwd;
+	// the bits of a long word are read from the least significant one
+	uc->bits |= uint64_t(reverseBits(lwd)) << (32 - uc->bitsCount);
+	uc->bitsCount += 32;
 }
 
 static int getBits(UnpackCtx *uc, int count) { // rdd1bits
-	int bits = 0;
-	for (int i = 0; i < count; ++i) {
-		bits <<= 1;
-		if (nextBit(uc)) {
-			bits |= 1;
-		}
+	// a long word is only read when its bits are needed, as the crc depends on it
+	if (uc->bitsCount < count) {
+		refill(uc);
 	}
+	const int bits = int(uc->bits >> (64 - count));
+	uc->bits <<= count;
+	uc->bitsCount -= count;
 	return bits;
 }
 
@@ -58,8 +64,13 @@ static void copyReference(UnpackCtx *uc, int bitsCount, int count) { // copyd3by
 		uc->size = 0;
 	}
 	const int offset = getBits(uc, bitsCount);
-	for (int i = 0; i < count; ++i) {
-		*(uc->dst - i) = *(uc->dst - i + offset);
+	if (offset >= count) {
+		// the source and destination do not overlap
+		memcpy(uc->dst - count + 1, uc->dst - count + 1 + offset, count);
+	} else {
+		for (int i = 0; i < count; ++i) {
+			*(uc->dst - i) = *(uc->dst - i + offset);
+		}
 	}
 	uc->dst -= count;
 }
@@ -74,11 +85,17 @@ bool bytekiller_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSiz
 	}
 	uc.dst = dst + uc.size - 1;
 	uc.crc = READ_BE_UINT32(uc.src); uc.src -= 4;
-	uc.bits = READ_BE_UINT32(uc.src); uc.src -= 4;
-	uc.crc ^= uc.bits;
+	const uint32_t lwd = READ_BE_UINT32(uc.src); uc.src -= 4;
+	uc.crc ^= lwd;
+	// the first long word is terminated by its most significant set bit
+	uc.bitsCount = 0;
+	while (uc.bitsCount < 31 && (lwd >> (uc.bitsCount + 1)) != 0) {
+		++uc.bitsCount;
+	}
+	uc.bits = (uc.bitsCount == 0) ? 0 : uint64_t(reverseBits(lwd) & (0xFFFFFFFF << (32 - uc.bitsCount))) << 32;
 	do {
-		if (!nextBit(&uc)) {
-			if (!nextBit(&uc)) {
+		if (!getBits(&uc, 1)) {
+			if (!getBits(&uc, 1)) {
 				copyLiteral(&uc, 3, 0);
 			} else {
 				copyReference(&uc, 8, 2);
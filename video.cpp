@@ -5,6 +5,7 @@
 
 #include "video.h"
 #include "bitmap.h"
+#include "bitmapcache.h"
 #include "graphics.h"
 #include "resource.h"
 #include "resource_3do.h"
@@ -15,10 +16,13 @@
 
 Video::Video(Resource *res)
 	: _res(res), _graphics(0), _hasHeadSprites(false), _displayHead(true) {
+	_bitmapCache = new BitmapCache;
+	_bitmapNum = -1;
 }
 
 Video::~Video() {
 	free(_scalerBuffer);
+	delete _bitmapCache;
 }
 
 void Video::init() {
@@ -29,6 +33,7 @@ void Video::init() {
 	_pData.byteSwap = (_res->getDataType() == Resource::DT_3DO);
 	_scaler = 0;
 	_scalerBuffer = 0;
+	_bitmapCache->setMaxSize(_bitmapCacheSize * 1024);
 }
 
 void Video::setScaler(const char *name, int factor) {
@@ -335,9 +340,18 @@ void Video::drawString(uint8_t color, uint16_t x, uint16_t y, uint16_t strId) {
 		return;
 	}
 	debug(DBG_VIDEO, "drawString(%d, %d, %d, '%s')", color, x, y, str);
+	// glyphs are collected and submitted to the renderer in batches
+	static const int kMaxChars = 64;
+	char chars[kMaxChars];
+	Point pts[kMaxChars];
+	int count = 0;
 	uint16_t xx = x;
 	int len = strlen(str);
 	for (int i = 0; i < len; ++i) {
+		if (count == kMaxChars) {
+			_graphics->drawStringChars(_buffers[0], color, chars, pts, count);
+			count = 0;
+		}
 		if (str[i] == '\n' || str[i] == '\r') {
 			y += 8;
 			x = xx;
@@ -351,19 +365,24 @@ void Video::drawString(uint8_t color, uint16_t x, uint16_t y, uint16_t strId) {
 					break;
 				case '2':
 				case '3':
-					Point pt(x * 8, y);
-					_graphics->drawStringChar(_buffers[0], color, (str[i] - '0') * 10 + (str[i+1] - '0'), &pt);
+					chars[count] = (str[i] - '0') * 10 + (str[i+1] - '0');
+					pts[count] = Point(x * 8, y);
+					++count;
 					++x;
 					++i;
 					break;
 				}
 			}
 		} else {
-			Point pt(x * 8, y);
-			_graphics->drawStringChar(_buffers[0], color, str[i], &pt);
+			chars[count] = str[i];
+			pts[count] = Point(x * 8, y);
+			++count;
 			++x;
 		}
 	}
+	if (count != 0) {
+		_graphics->drawStringChars(_buffers[0], color, chars, pts, count);
+	}
 }
 
 uint8_t Video::getPagePtr(uint8_t page) {
@@ -410,40 +429,46 @@ void Video::copyPage(uint8_t src, uint8_t dst, int16_t vscroll) {
 	}
 }
 
-static void decode_amiga(const uint8_t *src, uint8_t *dst) {
-	static const int plane_size = 200 * 320 / 8;
-	for (int y = 0; y < 200; ++y) {
-		for (int x = 0; x < 320; x += 8) {
+// planar to chunky lookup table, expands the 8 bits of a plane byte to 8 pixels
+static uint64_t _c2pTable[256];
+
+static void initC2PTable() {
+	static bool initialized = false;
+	if (!initialized) {
+		for (int i = 0; i < 256; ++i) {
+			uint8_t pixels[8];
 			for (int b = 0; b < 8; ++b) {
-				const int mask = 1 << (7 - b);
-				uint8_t color = 0;
-				for (int p = 0; p < 4; ++p) {
-					if (src[p * plane_size] & mask) {
-						color |= 1 << p;
-					}
-				}
-				*dst++ = color;
+				pixels[b] = (i >> (7 - b)) & 1;
 			}
-			++src;
+			memcpy(&_c2pTable[i], pixels, sizeof(uint64_t));
 		}
+		initialized = true;
+	}
+}
+
+static inline void c2p8(uint8_t p0, uint8_t p1, uint8_t p2, uint8_t p3, uint8_t *dst) {
+	// each pixel byte is at most 1, the shifts never cross into the next pixel
+	const uint64_t pixels = _c2pTable[p0] | (_c2pTable[p1] << 1) | (_c2pTable[p2] << 2) | (_c2pTable[p3] << 3);
+	memcpy(dst, &pixels, sizeof(uint64_t));
+}
+
+static void decode_amiga(const uint8_t *src, uint8_t *dst) {
+	static const int plane_size = 200 * 320 / 8;
+	initC2PTable();
+	for (int i = 0; i < plane_size; ++i) {
+		c2p8(src[0], src[plane_size], src[plane_size * 2], src[plane_size * 3], dst);
+		++src;
+		dst += 8;
 	}
 }
 
 static void decode_atari(const uint8_t *src, uint8_t *dst) {
-	for (int y = 0; y < 200; ++y) {
-		for (int x = 0; x < 320; x += 16) {
-			for (int b = 0; b < 16; ++b) {
-				const int mask = 1 << (15 - b);
-				uint8_t color = 0;
-				for (int p = 0; p < 4; ++p) {
-					if (READ_BE_UINT16(src + p * 2) & mask) {
-						color |= 1 << p;
-					}
-				}
-				*dst++ = color;
-			}
-			src += 8;
-		}
+	initC2PTable();
+	for (int i = 0; i < 200 * 320 / 16; ++i) {
+		c2p8(src[0], src[2], src[4], src[6], dst);
+		c2p8(src[1], src[3], src[5], src[7], dst + 8);
+		src += 8;
+		dst += 16;
 	}
 }
 
@@ -470,13 +495,43 @@ void Video::scaleBitmap(const uint8_t *src, int fmt) {
 		const int h = BITMAP_H * _scalerFactor;
 		const int depth = (fmt == FMT_CLUT) ? 1 : 2;
 		_scaler->scale(_scalerFactor, depth, _scalerBuffer, w * depth, src, BITMAP_W * depth, BITMAP_W, BITMAP_H);
-		_graphics->drawBitmap(0, _scalerBuffer, w, h, fmt);
+		drawDecodedBitmap(_scalerBuffer, w, h, fmt);
 	} else {
-		_graphics->drawBitmap(0, src, BITMAP_W, BITMAP_H, fmt);
+		drawDecodedBitmap(src, BITMAP_W, BITMAP_H, fmt);
+	}
+}
+
+void Video::drawDecodedBitmap(const uint8_t *data, int w, int h, int fmt) {
+	if (_bitmapNum >= 0) {
+		int depth = 1;
+		switch (fmt) {
+		case FMT_RGB555:
+			depth = 2;
+			break;
+		case FMT_RGB:
+			depth = 3;
+			break;
+		}
+		_bitmapCache->add(_bitmapNum, _res->getDataType(), fmt, w, h, data, w * h * depth);
 	}
+	// the remastered RGB bitmaps are drawn to the work page
+	const int listNum = (fmt == FMT_RGB) ? _buffers[0] : 0;
+	_graphics->drawBitmap(listNum, data, w, h, fmt);
 }
 
-void Video::copyBitmapPtr(const uint8_t *src, uint32_t size) {
+bool Video::drawCachedBitmap(int num) {
+	const BitmapCacheEntry *e = _bitmapCache->find(num, _res->getDataType());
+	if (e) {
+		debug(DBG_VIDEO, "Video::drawCachedBitmap() num %d", num);
+		const int listNum = (e->fmt == FMT_RGB) ? _buffers[0] : 0;
+		_graphics->drawBitmap(listNum, e->data, e->w, e->h, e->fmt);
+		return true;
+	}
+	return false;
+}
+
+void Video::copyBitmapPtr(const uint8_t *src, uint32_t size, int num) {
+	_bitmapNum = num;
 	if (_res->getDataType() == Resource::DT_DOS || _res->getDataType() == Resource::DT_AMIGA) {
 		decode_amiga(src, _tempBitmap);
 		scaleBitmap(_tempBitmap, FMT_CLUT);
@@ -502,11 +557,18 @@ void Video::copyBitmapPtr(const uint8_t *src, uint32_t size) {
 			int w, h;
 			uint8_t *buf = decode_bitmap(src, false, -1, &w, &h);
 			if (buf) {
-				_graphics->drawBitmap(_buffers[0], buf, w, h, FMT_RGB);
+				drawDecodedBitmap(buf, w, h, FMT_RGB);
 				free(buf);
 			}
 		}
 	}
+	_bitmapNum = -1;
+}
+
+void Video::copyBitmapRGB(const uint8_t *rgb, int w, int h, int num) {
+	_bitmapNum = num;
+	drawDecodedBitmap(rgb, w, h, FMT_RGB);
+	_bitmapNum = -1;
 }
 
 static void readPaletteWin31(const uint8_t *buf, int num, Color pal[16]) {
@@ -14,6 +14,7 @@ struct StrEntry {
 	const char *str;
 };
 
+struct BitmapCache;
 struct Graphics;
 struct Resource;
 struct Scaler;
@@ -39,6 +40,7 @@ struct Video {
 	static const uint8_t _paletteEGA[];
 
 	static bool _useEGA;
+	static int _bitmapCacheSize;
 
 	Resource *_res;
 	Graphics *_graphics;
@@ -55,6 +57,8 @@ struct Video {
 	const Scaler *_scaler;
 	int _scalerFactor;
 	uint8_t *_scalerBuffer;
+	BitmapCache *_bitmapCache;
+	int _bitmapNum;
 
 	Video(Resource *res);
 	~Video();
@@ -76,7 +80,10 @@ struct Video {
 	void fillPage(uint8_t page, uint8_t color);
 	void copyPage(uint8_t src, uint8_t dst, int16_t vscroll);
 	void scaleBitmap(const uint8_t *src, int fmt);
-	void copyBitmapPtr(const uint8_t *src, uint32_t size = 0);
+	void drawDecodedBitmap(const uint8_t *data, int w, int h, int fmt);
+	bool drawCachedBitmap(int num);
+	void copyBitmapPtr(const uint8_t *src, uint32_t size = 0, int num = -1);
+	void copyBitmapRGB(const uint8_t *rgb, int w, int h, int num = -1);
 	void changePal(uint8_t pal);
 	void updateDisplay(uint8_t page, SystemStub *stub);
 	void captureDisplay();